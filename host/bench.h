@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <3ds/types.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_CYCLES 1
+#else
+#define BENCH_HAVE_CYCLES 0
+#endif
+
+static inline u64 bench_nsec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline u64 bench_cycles(void)
+{
+#if BENCH_HAVE_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// reads a whole file into a new buffer with `slack` extra bytes after it
+static inline u8 *bench_load_file(const char *path, u32 *size, u32 slack)
+{
+  FILE *fp;
+  long len;
+  u8 *buf;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+  {
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  buf = malloc(len + slack + 1);
+  if (buf == NULL || fread(buf, 1, len, fp) != (size_t)len)
+  {
+    free(buf);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+  *size = (u32)len;
+  return buf;
+}
+
+// memory the loader can address through a u32, like process memory on the
+// console, which a large malloc on a 64-bit host is not
+static inline u8 *bench_alloc_low(u32 size)
+{
+#ifdef MAP_32BIT
+  void *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+  return buf == MAP_FAILED ? NULL : buf;
+#else
+  return malloc(size);
+#endif
+}
+
+static inline void bench_free_low(u8 *buf, u32 size)
+{
+#ifdef MAP_32BIT
+  munmap(buf, size);
+#else
+  free(buf);
+#endif
+}
+
+// FNV-1a, used to compare decoder outputs between runs
+static inline u32 bench_checksum(const u8 *buf, u32 size)
+{
+  u32 hash;
+  u32 i;
+
+  hash = 0x811C9DC5;
+  for (i = 0; i < size; i++)
+  {
+    hash = (hash ^ buf[i]) * 0x01000193;
+  }
+  return hash;
+}
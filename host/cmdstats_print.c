@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "cmdstats.h"
+#include "commands.h"
+
+// Prints the command latency histograms in a /loader/cmdstats.bin, written
+// by the Loader's GetCommandStats command (see cmdstats.h). Percentiles are
+// the upper end of the bucket they fall in.
+
+#define BAR_WIDTH 40
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s cmdstats.bin\n", prog);
+}
+
+// the first usec value past a bucket
+static double bucket_end(u32 bucket)
+{
+  return (double)(2U << bucket);
+}
+
+static double percentile(const cmdstats_entry *entry, u32 buckets, u32 percent)
+{
+  u64 seen;
+  u32 i;
+
+  seen = 0;
+  for (i = 0; i < buckets; i++)
+  {
+    seen += entry->buckets[i];
+    if (seen * 100 >= (u64)entry->count * percent)
+    {
+      break;
+    }
+  }
+  // the last bucket has no upper end
+  if (i >= buckets - 1 || bucket_end(i) > entry->max)
+  {
+    return entry->max;
+  }
+  return bucket_end(i);
+}
+
+static void print_entry(const cmdstats_entry *entry, u32 buckets)
+{
+  u32 most;
+  u32 i;
+  int bar;
+
+  printf("%-22s %8u %10.3f %10.3f %10.3f %10.3f\n", command_name(entry->id), entry->count,
+    percentile(entry, buckets, 50) / 1e3, percentile(entry, buckets, 90) / 1e3,
+    percentile(entry, buckets, 99) / 1e3, entry->max / 1e3);
+  most = 0;
+  for (i = 0; i < buckets; i++)
+  {
+    most = entry->buckets[i] > most ? entry->buckets[i] : most;
+  }
+  for (i = 0; i < buckets; i++)
+  {
+    if (entry->buckets[i] == 0)
+    {
+      continue;
+    }
+    bar = (int)(((u64)entry->buckets[i] * BAR_WIDTH + most - 1) / most);
+    if (i == 0)
+    {
+      printf("  %10s - %9.3f ms ", "0", bucket_end(0) / 1e3);
+    }
+    else if (i == buckets - 1)
+    {
+      printf("  %10.3f ms and up    ", (bucket_end(i) / 2) / 1e3);
+    }
+    else
+    {
+      printf("  %10.3f - %9.3f ms ", (bucket_end(i) / 2) / 1e3, bucket_end(i) / 1e3);
+    }
+    printf("%-*.*s %u\n", BAR_WIDTH, bar, "########################################", entry->buckets[i]);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  cmdstats_file_header header;
+  const cmdstats_entry *entries;
+  u8 *file;
+  u32 size;
+  u32 i;
+
+  if (argc != 2)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  file = bench_load_file(argv[1], &size, 0);
+  if (file == NULL)
+  {
+    fprintf(stderr, "%s: cannot read\n", argv[1]);
+    return 1;
+  }
+  if (size >= sizeof(header))
+  {
+    memcpy(&header, file, sizeof(header));
+  }
+  if (size < sizeof(header) || header.magic != CMDSTATS_MAGIC || header.version != CMDSTATS_VERSION ||
+      header.buckets != CMDSTATS_BUCKETS || header.count > CMDSTATS_COMMANDS ||
+      size != sizeof(header) + header.count * sizeof(cmdstats_entry))
+  {
+    fprintf(stderr, "%s: not a command stats file\n", argv[1]);
+    free(file);
+    return 1;
+  }
+  entries = (const cmdstats_entry *)(file + sizeof(header));
+
+  // latencies in msec, from the request coming in to the reply going out
+  printf("%-22s %8s %10s %10s %10s %10s\n", "command", "count", "p50", "p90", "p99", "max");
+  for (i = 0; i < header.count; i++)
+  {
+    print_entry(&entries[i], header.buckets);
+  }
+  free(file);
+  return 0;
+}
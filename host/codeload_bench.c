@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "shim.h"
+#include "ifile.h"
+#include "codeload.h"
+#include "lzblock.h"
+#include "profile.h"
+#include "patcher.h"
+
+#define DEFAULT_REQUEST_USEC 200
+#define DEFAULT_BYTES_PER_USEC 8
+
+typedef struct
+{
+  const char *name;
+  u64 progid;
+} title_t;
+
+// one title for every patch set in patcher.c
+static const title_t g_titles[] =
+{
+  { "menu", 0x0004003000008F02LL },
+  { "nim", 0x0004013000002C02LL },
+  { "ns", 0x0004013000008002LL },
+  { "cfg", 0x0004013000001702LL },
+};
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-l usec] [-b MB/s] [-t title] code.bin...\n", prog);
+  fprintf(stderr, "  -l  stand-in FS latency per read request (default %d)\n", DEFAULT_REQUEST_USEC);
+  fprintf(stderr, "  -b  stand-in FS bandwidth, 0 is unlimited (default %d)\n", DEFAULT_BYTES_PER_USEC);
+  fprintf(stderr, "  -t  also patch each image as this title (menu, nim, ns, cfg or a program ID\n");
+  fprintf(stderr, "      in hex), searched after the load and during it, which must agree\n");
+}
+
+static int open_code(const char *path, IFile *file, u64 *size)
+{
+  if (R_FAILED(host_fs_open(path, FS_OPEN_READ, &file->handle)))
+  {
+    return -1;
+  }
+  file->pos = 0;
+  return R_FAILED(IFile_GetSize(file, size)) ? -1 : 0;
+}
+
+// time one codeload_read of the file, 0 on failure
+static u64 time_load(const char *path, u8 *code, int is_compressed)
+{
+  IFile file;
+  u64 size;
+  u64 t0;
+  u64 t1;
+  Result res;
+
+  if (open_code(path, &file, &size) < 0)
+  {
+    return 0;
+  }
+  t0 = bench_nsec();
+  res = codeload_read(&file, code, (u32)size, is_compressed);
+  t1 = bench_nsec();
+  IFile_Close(&file);
+  return R_SUCCEEDED(res) ? t1 - t0 : 0;
+}
+
+// one load of the file into process memory at work, patched as progid,
+// with the patches searched for while it is loaded if fused
+static int load_patched(const char *path, u8 *work, u32 size, u32 outsize, u64 progid, int fused)
+{
+  exheader_codesetinfo codeset;
+  prog_addrs_t shared;
+
+  memset(&codeset, 0, sizeof(codeset));
+  codeset.text.codesize = outsize;
+  memset(&shared, 0, sizeof(shared));
+  shared.text_addr = (u32)work;
+  shared.text_size = (outsize + 4095) >> 12;
+  shared.ro_addr = shared.text_addr + (shared.text_size << 12);
+  shared.data_addr = shared.ro_addr;
+  shared.total_size = shared.text_size;
+  memset(work, 0, shared.total_size << 12);
+  if (fused)
+  {
+    patch_scan_begin(progid, &shared, &codeset);
+    if (time_load(path, work, 1) == 0)
+    {
+      return -1;
+    }
+  }
+  else
+  {
+    if (time_load(path, work, 0) == 0)
+    {
+      return -1;
+    }
+    codeload_decompress(work, size);
+  }
+  patch_code(progid, &shared, &codeset);
+  return 0;
+}
+
+static u32 count_changed(const u8 *image, const u8 *patched, u32 size)
+{
+  u32 changed;
+  u32 i;
+
+  changed = 0;
+  for (i = 0; i < size; i++)
+  {
+    changed += image[i] != patched[i];
+  }
+  return changed;
+}
+
+// the patched image must come out the same whether the search ran during
+// decoding or after it, image is the unpatched one
+static int check_fused(const char *path, const u8 *image, u32 size, u32 outsize, u64 progid)
+{
+  u8 *plain;
+  u8 *fused;
+  u32 pages;
+  u32 plain_changed;
+  u32 fused_changed;
+  int same;
+
+  pages = ((outsize + 4095) >> 12) << 12;
+  plain = bench_alloc_low(pages);
+  fused = bench_alloc_low(pages);
+  if (plain == NULL || fused == NULL ||
+      load_patched(path, plain, size, outsize, progid, 0) < 0 ||
+      load_patched(path, fused, size, outsize, progid, 1) < 0)
+  {
+    fprintf(stderr, "%s: read failed\n", path);
+    same = 0;
+  }
+  else
+  {
+    plain_changed = count_changed(image, plain, outsize);
+    fused_changed = count_changed(image, fused, outsize);
+    same = memcmp(plain, fused, outsize) == 0;
+    printf("%-32s %016llX bytes patched: %u searched after the load, %u during it %s\n", path,
+      (unsigned long long)progid, plain_changed, fused_changed, same ? "ok" : "MISMATCH");
+  }
+  if (plain != NULL)
+  {
+    bench_free_low(plain, pages);
+  }
+  if (fused != NULL)
+  {
+    bench_free_low(fused, pages);
+  }
+  return same ? 0 : -1;
+}
+
+static int bench_file(const char *path, u64 progid)
+{
+  IFile file;
+  u64 size;
+  u32 outsize;
+  u32 add;
+  u8 *code;
+  u8 *check;
+  u64 io;
+  u64 decode;
+  u64 piped;
+  u64 serial;
+  u64 bound;
+  u64 t0;
+  profile_record record;
+  lzblock_index index;
+
+  if (open_code(path, &file, &size) < 0)
+  {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return -1;
+  }
+  file.pos = size - 4;
+  if (R_FAILED(IFile_Read(&file, &t0, &add, 4)))
+  {
+    IFile_Close(&file);
+    return -1;
+  }
+  IFile_Close(&file);
+  outsize = (u32)size + add;
+  if (add == LZBLOCK_MAGIC)
+  {
+    check = bench_load_file(path, &outsize, 0);
+    outsize = lzblock_read_index(&index, check, outsize) ? index.image_size : 0;
+    free(check);
+    if (outsize < size)
+    {
+      fprintf(stderr, "%s: bad block image\n", path);
+      return -1;
+    }
+  }
+  code = malloc(outsize);
+  check = malloc(outsize);
+
+  // I/O alone, then decode alone on the loaded image, then both pipelined
+  io = time_load(path, check, 0);
+  t0 = bench_nsec();
+  codeload_decompress(check, (u32)size);
+  decode = bench_nsec() - t0;
+  // the loader's own profile tells how long the pipelined load decoded for
+  profile_begin();
+  piped = time_load(path, code, 1);
+  profile_end(0, 0);
+  profile_read(&record, 1);
+  if (io == 0 || piped == 0)
+  {
+    fprintf(stderr, "%s: read failed\n", path);
+    free(code);
+    free(check);
+    return -1;
+  }
+
+  serial = io + decode;
+  bound = io > decode ? io : decode;
+  printf("%-32s %9u %9.2f %9.2f %9.2f %9.2f %9.2f %6.1f%% %s\n", path, outsize,
+    io / 1e6, decode / 1e6, serial / 1e6, piped / 1e6,
+    record.ticks[PROFILE_DECOMPRESS] * 1e3 / SYSCLOCK_ARM11,
+    serial > bound ? 100.0 * ((double)serial - piped) / (serial - bound) : 0.0,
+    memcmp(code, check, outsize) ? "MISMATCH" : "ok");
+  t0 = memcmp(code, check, outsize);
+  if (t0 == 0 && progid != 0 && add != LZBLOCK_MAGIC && check_fused(path, check, (u32)size, outsize, progid) < 0)
+  {
+    t0 = 1;
+  }
+  free(code);
+  free(check);
+  return t0 ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  host_fs_latency latency;
+  u64 progid;
+  u32 t;
+  int failed;
+  int i;
+
+  latency.request_usec = DEFAULT_REQUEST_USEC;
+  latency.bytes_per_usec = DEFAULT_BYTES_PER_USEC;
+  progid = 0;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+    {
+      latency.request_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+    {
+      latency.bytes_per_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      i++;
+      for (t = 0; t < sizeof(g_titles) / sizeof(g_titles[0]) && strcmp(argv[i], g_titles[t].name) != 0; t++);
+      progid = t < sizeof(g_titles) / sizeof(g_titles[0]) ? g_titles[t].progid : strtoull(argv[i], NULL, 16);
+      if (progid == 0)
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i >= argc)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  host_fs_set_latency(&latency);
+
+  // overlap is the share of the smaller of I/O and decode hidden by pipelining
+  printf("%-32s %9s %9s %9s %9s %9s %9s %7s %s\n", "image", "unpacked", "io ms", "dec ms", "serial", "piped", "pipe dec", "overlap", "exact");
+  failed = 0;
+  for (; i < argc; i++)
+  {
+    if (bench_file(argv[i], progid) < 0)
+    {
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// names of the Loader commands, for printing
+static inline const char *command_name(u32 id)
+{
+  switch (id)
+  {
+    case 1: return "LoadProcess";
+    case 2: return "RegisterProgram";
+    case 3: return "UnregisterProgram";
+    case 4: return "GetProgramInfo";
+    case 0x100: return "GetLoadProfile";
+    case 0x101: return "GetExheaderCacheStats";
+    case 0x102: return "GetPatchStats";
+    case 0x103: return "GetCommandStats";
+    default: return "?";
+  }
+}
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "shim.h"
+#include "exhcache.h"
+#include "fsreg.h"
+
+// Fetches the exheaders of a boot's worth of system modules from the fs:REG
+// stand-in one at a time, the way loader_GetProgramInfo does, and in batches
+// through exhcache_fetch. A batch assumes the next programs got the handles
+// after the first one's, an entry that does not check out is fetched again
+// on its own with the rest of its batch. -g registers a program the bench
+// does not ask about after every few, so batches run into ones that do not.
+
+#define DEFAULT_TITLES 40
+#define DEFAULT_BATCH 8
+#define DEFAULT_REQUEST_USEC 100
+#define DEFAULT_ENTRY_USEC 5
+#define RUNS 3
+#define FIRST_PROGID 0x0004013000001002ULL
+#define STRAY_PROGID 0x0004013000FF0002ULL
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-n titles] [-b batch] [-g gap] [-l usec] [-e usec]\n", prog);
+  fprintf(stderr, "  -n  programs to fetch (default %d)\n", DEFAULT_TITLES);
+  fprintf(stderr, "  -b  largest batch, 0 runs 1, 2, 4 and so on up to the titles (default %d)\n", DEFAULT_BATCH);
+  fprintf(stderr, "  -g  register another program after every gap programs, 0 is none (default)\n");
+  fprintf(stderr, "  -l  stand-in fs:REG latency per request (default %d)\n", DEFAULT_REQUEST_USEC);
+  fprintf(stderr, "  -e  stand-in fs:REG cost per exheader returned (default %d)\n", DEFAULT_ENTRY_USEC);
+}
+
+static int check(const exheader_header *exheaders, const u64 *progids, u32 count)
+{
+  u32 i;
+
+  for (i = 0; i < count; i++)
+  {
+    if (exheaders[i].arm11systemlocalcaps.programid != progids[i])
+    {
+      fprintf(stderr, "exheader %u does not belong to its program\n", i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// the loader's path for every program pm asks about, 0 on failure
+static u64 time_single(const u64 *handles, const u64 *progids, u32 count, exheader_header *exheaders)
+{
+  u64 t0;
+  u64 t;
+  u32 i;
+
+  memset(exheaders, 0, count * sizeof(exheader_header));
+  t0 = bench_nsec();
+  for (i = 0; i < count; i++)
+  {
+    if (R_FAILED(FSREG_CheckHostLoadId(handles[i])) ||
+        R_FAILED(FSREG_GetProgramInfo(&exheaders[i], 1, handles[i])))
+    {
+      return 0;
+    }
+  }
+  t = bench_nsec() - t0;
+  return check(exheaders, progids, count) < 0 ? 0 : t;
+}
+
+static u64 time_batched(const u64 *handles, const u64 *progids, u32 count, u32 batch,
+  exheader_header *exheaders, u32 *requests)
+{
+  u64 t0;
+  u64 t;
+  u32 checked;
+  u32 i;
+  u32 j;
+  u32 n;
+
+  memset(exheaders, 0, count * sizeof(exheader_header));
+  *requests = 0;
+  t0 = bench_nsec();
+  for (i = 0; i < count; i += n)
+  {
+    n = count - i < batch ? count - i : batch;
+    checked = exhcache_fetch(handles[i], &progids[i], n, &exheaders[i]);
+    (*requests)++;
+    for (j = i + checked; j < i + n; j++)
+    {
+      (*requests)++;
+      if (exhcache_fetch(handles[j], &progids[j], 1, &exheaders[j]) != 1)
+      {
+        return 0;
+      }
+    }
+  }
+  t = bench_nsec() - t0;
+  return check(exheaders, progids, count) < 0 ? 0 : t;
+}
+
+int main(int argc, char *argv[])
+{
+  host_fsreg_latency latency;
+  FS_ProgramInfo info;
+  exheader_header *exheaders;
+  u64 *handles;
+  u64 *progids;
+  u64 stray[256];
+  u64 single;
+  u64 batched;
+  u64 t;
+  u32 titles;
+  u32 batch;
+  u32 gap;
+  u32 strays;
+  u32 requests;
+  u32 b;
+  int run;
+  int i;
+
+  titles = DEFAULT_TITLES;
+  batch = DEFAULT_BATCH;
+  gap = 0;
+  latency.request_usec = DEFAULT_REQUEST_USEC;
+  latency.entry_usec = DEFAULT_ENTRY_USEC;
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+    {
+      titles = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+    {
+      batch = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+    {
+      gap = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+    {
+      latency.request_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+    {
+      latency.entry_usec = atoi(argv[++i]);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (titles == 0 || titles > 120)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // registered back to back, so FS hands out consecutive handles unless
+  // another program comes in between
+  handles = malloc(titles * sizeof(u64));
+  progids = malloc(titles * sizeof(u64));
+  exheaders = malloc(titles * sizeof(exheader_header));
+  memset(&info, 0, sizeof(info));
+  info.mediaType = MEDIATYPE_NAND;
+  strays = 0;
+  for (i = 0; i < titles; i++)
+  {
+    progids[i] = FIRST_PROGID + ((u64)i << 8);
+    info.programId = progids[i];
+    if (R_FAILED(FSREG_LoadProgram(&handles[i], &info)))
+    {
+      fprintf(stderr, "cannot register %u programs\n", titles);
+      return 1;
+    }
+    if (gap && i % gap == gap - 1)
+    {
+      info.programId = STRAY_PROGID;
+      if (R_FAILED(FSREG_LoadProgram(&stray[strays++], &info)))
+      {
+        fprintf(stderr, "cannot register %u programs\n", titles);
+        return 1;
+      }
+    }
+  }
+  host_fsreg_set_latency(&latency);
+
+  single = ~0ULL;
+  for (run = 0; run < RUNS; run++)
+  {
+    t = time_single(handles, progids, titles, exheaders);
+    if (t == 0)
+    {
+      fprintf(stderr, "1-by-1 fetch failed\n");
+      return 1;
+    }
+    single = t < single ? t : single;
+  }
+
+  // 1-by-1 checks each handle with FS first, as loader_GetProgramInfo does
+  printf("%6s %6s %9s %9s %9s %8s %7s\n", "titles", "batch", "requests", "1-by-1 ms", "requests", "batch ms", "speedup");
+  for (b = batch ? batch : 1; b <= (batch ? batch : titles); b = batch ? b + 1 : b * 2)
+  {
+    batched = ~0ULL;
+    for (run = 0; run < RUNS; run++)
+    {
+      t = time_batched(handles, progids, titles, b, exheaders, &requests);
+      if (t == 0)
+      {
+        fprintf(stderr, "batched fetch failed\n");
+        return 1;
+      }
+      batched = t < batched ? t : batched;
+    }
+    printf("%6u %6u %9u %9.3f %9u %8.3f %6.2fx\n", titles, b, 2 * titles, single / 1e6,
+      requests, batched / 1e6, (double)single / batched);
+  }
+
+  for (i = 0; i < titles; i++)
+  {
+    FSREG_UnloadProgram(handles[i]);
+  }
+  for (i = 0; i < strays; i++)
+  {
+    FSREG_UnloadProgram(stray[i]);
+  }
+  free(exheaders);
+  free(progids);
+  free(handles);
+  return 0;
+}
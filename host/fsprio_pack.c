@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fsprio.h"
+
+// Builds the /loader/fsprio.bin the loader takes its fs:LDR priorities from,
+// see fsprio.h. The input is text, one rule per line, # starts a comment:
+//
+//   00040000 * 0           # applications
+//   * application 0
+//   00040130 system 2      # sysmodules
+//   * * 1
+//
+// A rule gives the upper half of the program ID in hex, the memory type
+// (application, system or base) and the priority, * matches anything. The
+// first rule a program matches is the one it gets, a program that matches
+// none keeps the priority the loader has between loads.
+
+#define MAX_RULES 16
+#define LINE_MAX 1024
+
+static const char *const g_memtypes[] = { "*", "application", "system", "base" };
+
+static fsprio_rule g_rules[MAX_RULES];
+static u32 g_count;
+
+static int fail(const char *path, int line, const char *msg)
+{
+  fprintf(stderr, "%s:%d: %s\n", path, line, msg);
+  return -1;
+}
+
+static int parse_rule(char *tok, char **save, const char *path, int line)
+{
+  fsprio_rule *rule;
+  char *end;
+  u32 i;
+
+  if (g_count == MAX_RULES)
+  {
+    return fail(path, line, "too many rules");
+  }
+  rule = &g_rules[g_count];
+  if (strcmp(tok, "*") == 0)
+  {
+    rule->category = 0;
+    rule->mask = 0;
+  }
+  else
+  {
+    rule->category = strtoul(tok, &end, 16);
+    rule->mask = 0xFFFFFFFF;
+    if (*end != '\0' || strlen(tok) > 8)
+    {
+      return fail(path, line, "bad program ID category");
+    }
+  }
+
+  tok = strtok_r(NULL, " \t\r\n", save);
+  for (i = 0; tok != NULL && i < sizeof(g_memtypes) / sizeof(g_memtypes[0]); i++)
+  {
+    if (strcmp(tok, g_memtypes[i]) == 0)
+    {
+      break;
+    }
+  }
+  if (tok == NULL || i == sizeof(g_memtypes) / sizeof(g_memtypes[0]))
+  {
+    return fail(path, line, "expected application, system, base or *");
+  }
+  rule->memtype = i;
+
+  tok = strtok_r(NULL, " \t\r\n", save);
+  if (tok == NULL)
+  {
+    return fail(path, line, "expected a priority");
+  }
+  rule->priority = strtoul(tok, &end, 0);
+  if (*end != '\0' || strtok_r(NULL, " \t\r\n", save) != NULL)
+  {
+    return fail(path, line, "bad priority");
+  }
+  g_count++;
+  return 0;
+}
+
+static int parse_file(const char *path)
+{
+  FILE *fp;
+  char buf[LINE_MAX];
+  char *save;
+  char *tok;
+  char *hash;
+  int line;
+  int res;
+
+  fp = fopen(path, "r");
+  if (fp == NULL)
+  {
+    fprintf(stderr, "%s: cannot read\n", path);
+    return -1;
+  }
+  res = 0;
+  for (line = 1; res == 0 && fgets(buf, sizeof(buf), fp) != NULL; line++)
+  {
+    hash = strchr(buf, '#');
+    if (hash != NULL)
+    {
+      *hash = '\0';
+    }
+    tok = strtok_r(buf, " \t\r\n", &save);
+    if (tok != NULL)
+    {
+      res = parse_rule(tok, &save, path, line);
+    }
+  }
+  fclose(fp);
+  if (res == 0 && g_count == 0)
+  {
+    res = fail(path, line, "no rules");
+  }
+  return res;
+}
+
+int main(int argc, char *argv[])
+{
+  fsprio_header header;
+  FILE *fp;
+
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: %s fsprio.txt fsprio.bin\n", argv[0]);
+    return 1;
+  }
+  if (parse_file(argv[1]) < 0)
+  {
+    return 1;
+  }
+
+  header.magic = FSPRIO_MAGIC;
+  header.version = FSPRIO_VERSION;
+  header.count = g_count;
+  fp = fopen(argv[2], "wb");
+  if (fp == NULL ||
+      fwrite(&header, sizeof(header), 1, fp) != 1 ||
+      fwrite(g_rules, sizeof(fsprio_rule), g_count, fp) != g_count ||
+      fclose(fp) != 0)
+  {
+    fprintf(stderr, "%s: cannot write\n", argv[2]);
+    return 1;
+  }
+  printf("%u rules\n", g_count);
+  return 0;
+}
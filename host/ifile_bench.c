@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "shim.h"
+#include "ifile.h"
+
+// Sweeps the chunk size of IFile_ReadChunked and IFile_WriteChunked over a
+// file on the stand-in FS. The consumer of a read hashes each chunk, the
+// producer of a write copies it in from another buffer, either can be made
+// slower with -w to stand in for decompression. The first row is one plain
+// IFile_Read and IFile_Write for the whole file.
+
+#define DEFAULT_REQUEST_USEC 200
+#define DEFAULT_BYTES_PER_USEC 8
+#define DEFAULT_MB 4
+
+static const u32 g_chunks[] = { 0x1000, 0x4000, 0x10000, 0x40000, 0x100000 };
+
+typedef struct
+{
+  const u8 *source; // what a write copies in, the buffer's twin
+  u8 *buffer;
+  u32 hash;
+  u32 bytes_per_usec; // of the stand-in work, 0 is none
+  u64 nsec;           // spent working
+} work_t;
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-l usec] [-b MB/s] [-w MB/s] [-m MB] [file]\n", prog);
+  fprintf(stderr, "  reads file, or a scratch file of -m MB (default %d), and writes a scratch copy\n", DEFAULT_MB);
+  fprintf(stderr, "  -l  stand-in FS latency per request (default %d)\n", DEFAULT_REQUEST_USEC);
+  fprintf(stderr, "  -b  stand-in FS bandwidth, 0 is unlimited (default %d)\n", DEFAULT_BYTES_PER_USEC);
+  fprintf(stderr, "  -w  speed of the work on each chunk besides hashing or copying, 0 is none (default)\n");
+}
+
+static u32 fnv1a(u32 hash, const u8 *buf, u32 size)
+{
+  u32 i;
+
+  for (i = 0; i < size; i++)
+  {
+    hash = (hash ^ buf[i]) * 0x01000193;
+  }
+  return hash;
+}
+
+static void work(work_t *w, u32 len)
+{
+  if (w->bytes_per_usec)
+  {
+    svcSleepThread((s64)(len / w->bytes_per_usec) * 1000);
+  }
+}
+
+static void consume(void *arg, u8 *chunk, u32 len)
+{
+  work_t *w;
+  u64 t0;
+
+  w = (work_t *)arg;
+  t0 = bench_nsec();
+  w->hash = fnv1a(w->hash, chunk, len);
+  work(w, len);
+  w->nsec += bench_nsec() - t0;
+}
+
+static void produce(void *arg, u8 *chunk, u32 len)
+{
+  work_t *w;
+  u64 t0;
+
+  w = (work_t *)arg;
+  t0 = bench_nsec();
+  memcpy(chunk, w->source + (chunk - w->buffer), len);
+  work(w, len);
+  w->nsec += bench_nsec() - t0;
+}
+
+static int open_file(const char *path, u32 flags, IFile *file)
+{
+  if (R_FAILED(host_fs_open(path, flags, &file->handle)))
+  {
+    return -1;
+  }
+  file->pos = 0;
+  file->size = 0;
+  return 0;
+}
+
+// one read and one write of size bytes, chunk 0 is a plain IFile_Read and
+// IFile_Write with the work done before or after
+static int bench_chunk(const char *in, const char *out, u32 chunk, u32 size, u8 *buffer, work_t *w,
+  u32 expect)
+{
+  IFile file;
+  u64 total;
+  u64 read;
+  u64 work_read;
+  u64 write;
+  u64 work_write;
+  u64 t0;
+  u32 hash;
+  Result res;
+  int exact;
+
+  if (open_file(in, FS_OPEN_READ, &file) < 0)
+  {
+    return -1;
+  }
+  memset(buffer, 0, size);
+  w->hash = 0x811C9DC5;
+  w->nsec = 0;
+  t0 = bench_nsec();
+  if (chunk == 0)
+  {
+    res = IFile_Read(&file, &total, buffer, size);
+    consume(w, buffer, (u32)total);
+  }
+  else
+  {
+    res = IFile_ReadChunked(&file, &total, buffer, size, chunk, 0, consume, w);
+  }
+  read = bench_nsec() - t0;
+  work_read = w->nsec;
+  IFile_Close(&file);
+  exact = R_SUCCEEDED(res) && total == size && w->hash == expect;
+
+  if (open_file(out, FS_OPEN_WRITE | FS_OPEN_CREATE, &file) < 0)
+  {
+    return -1;
+  }
+  w->source = buffer;
+  w->buffer = buffer + size;
+  w->nsec = 0;
+  t0 = bench_nsec();
+  if (chunk == 0)
+  {
+    produce(w, w->buffer, size);
+    res = IFile_Write(&file, &total, w->buffer, size, 0);
+  }
+  else
+  {
+    res = IFile_WriteChunked(&file, &total, w->buffer, size, 0, chunk, produce, w);
+  }
+  write = bench_nsec() - t0;
+  work_write = w->nsec;
+  IFile_Close(&file);
+  if (open_file(out, FS_OPEN_READ, &file) < 0)
+  {
+    return -1;
+  }
+  hash = 0;
+  if (R_SUCCEEDED(res) && total == size && R_SUCCEEDED(IFile_Read(&file, &total, w->buffer, size)))
+  {
+    hash = bench_checksum(w->buffer, (u32)total);
+  }
+  IFile_Close(&file);
+  exact &= hash == expect;
+
+  // io is the time less the work, hid is how much of the work overlapped it
+  // against the plain transfer
+  if (chunk == 0)
+  {
+    printf("%8s", "whole");
+  }
+  else
+  {
+    printf("%8X", chunk);
+  }
+  printf(" %8u %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f  %s\n", chunk ? (size + chunk - 1) / chunk : 1,
+    read / 1e6, work_read / 1e6, (read > work_read ? read - work_read : 0) / 1e6,
+    write / 1e6, work_write / 1e6, (write > work_write ? write - work_write : 0) / 1e6,
+    exact ? "ok" : "MISMATCH");
+  return exact ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+  host_fs_latency latency;
+  work_t w;
+  char in[] = "/tmp/ifile_bench_inXXXXXX";
+  char out[] = "/tmp/ifile_bench_outXXXXXX";
+  const char *path;
+  u8 *buffer;
+  u8 *data;
+  u32 size;
+  u32 expect;
+  u32 seed;
+  u32 i;
+  int failed;
+  int fd;
+  int mb;
+
+  latency.request_usec = DEFAULT_REQUEST_USEC;
+  latency.bytes_per_usec = DEFAULT_BYTES_PER_USEC;
+  memset(&w, 0, sizeof(w));
+  mb = DEFAULT_MB;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+    {
+      latency.request_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+    {
+      latency.bytes_per_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+    {
+      w.bytes_per_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+    {
+      mb = atoi(argv[++i]);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i + 1 < argc || mb < 1)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  fd = -1;
+  if (i < argc)
+  {
+    path = argv[i];
+    data = bench_load_file(path, &size, 0);
+    if (data == NULL || size == 0)
+    {
+      fprintf(stderr, "%s: cannot read\n", path);
+      return 1;
+    }
+  }
+  else
+  {
+    fd = mkstemp(in);
+    size = (u32)mb << 20;
+    data = malloc(size);
+    if (fd < 0 || data == NULL)
+    {
+      fprintf(stderr, "cannot make a scratch file\n");
+      return 1;
+    }
+    seed = 1;
+    for (i = 0; i < size; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      data[i] = seed >> 16;
+    }
+    if (write(fd, data, size) != (ssize_t)size)
+    {
+      fprintf(stderr, "cannot make a scratch file\n");
+      unlink(in);
+      return 1;
+    }
+    close(fd);
+    path = in;
+  }
+  expect = bench_checksum(data, size);
+  free(data);
+  fd = mkstemp(out);
+  if (fd < 0)
+  {
+    fprintf(stderr, "cannot make a scratch file\n");
+    return 1;
+  }
+  close(fd);
+  // the file is read into the first half and written from the second
+  buffer = malloc(2 * size);
+  host_fs_set_latency(&latency);
+
+  // msec, io is the time the work did not hide
+  printf("%8s %8s %8s %8s %8s %8s %8s %8s  %s\n", "chunk", "requests", "read", "work", "io", "write",
+    "work", "io", "exact");
+  failed = bench_chunk(path, out, 0, size, buffer, &w, expect) < 0;
+  for (i = 0; i < sizeof(g_chunks) / sizeof(g_chunks[0]); i++)
+  {
+    if (bench_chunk(path, out, g_chunks[i], size, buffer, &w, expect) < 0)
+    {
+      failed = 1;
+    }
+  }
+
+  free(buffer);
+  unlink(out);
+  if (path == in)
+  {
+    unlink(in);
+  }
+  return failed;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file 3ds.h
+ * @brief Host stand-in for the parts of ctrulib the loader sources use.
+ *
+ * Kernel and service calls declared here are implemented in-process by the
+ * shim_*.c files so the loader modules can be compiled and run on Linux.
+ */
+#pragma once
+
+#include <3ds/types.h>
+
+// result codes
+
+#define R_SUCCEEDED(res) ((res)>=0)
+#define R_FAILED(res) ((res)<0)
+#define R_LEVEL(res) (((res)>>27)&0x1F)
+#define R_SUMMARY(res) (((res)>>21)&0x3F)
+#define R_MODULE(res) (((res)>>10)&0xFF)
+#define R_DESCRIPTION(res) ((res)&0x3FF)
+
+#define MAKERESULT(level,summary,module,description) \
+	((((level)&0x1F)<<27) | (((summary)&0x3F)<<21) | (((module)&0xFF)<<10) | ((description)&0x3FF))
+
+enum
+{
+	RL_SUCCESS = 0,
+	RL_INFO = 1,
+	RL_FATAL = 31,
+	RL_RESET = 30,
+	RL_REINITIALIZE = 29,
+	RL_USAGE = 28,
+	RL_PERMANENT = 27,
+	RL_TEMPORARY = 26,
+	RL_STATUS = 25,
+};
+
+enum
+{
+	RS_SUCCESS = 0,
+	RS_NOP = 1,
+	RS_WOULDBLOCK = 2,
+	RS_OUTOFRESOURCE = 3,
+	RS_NOTFOUND = 4,
+	RS_INVALIDSTATE = 5,
+	RS_NOTSUPPORTED = 6,
+	RS_INVALIDARG = 7,
+	RS_WRONGARG = 8,
+	RS_CANCELED = 9,
+	RS_STATUSCHANGED = 10,
+	RS_INTERNAL = 11,
+};
+
+enum
+{
+	RD_SUCCESS = 0,
+	RD_TIMEOUT = 1022,
+	RD_OUT_OF_RANGE = 1021,
+	RD_ALREADY_EXISTS = 1020,
+	RD_CANCEL_REQUESTED = 1019,
+	RD_NOT_FOUND = 1018,
+	RD_ALREADY_INITIALIZED = 1017,
+	RD_NOT_INITIALIZED = 1016,
+	RD_INVALID_HANDLE = 1015,
+	RD_INVALID_POINTER = 1014,
+	RD_INVALID_ADDRESS = 1013,
+	RD_NOT_IMPLEMENTED = 1012,
+	RD_OUT_OF_MEMORY = 1011,
+	RD_BUSY = 1002,
+};
+
+// kernel
+
+#define CUR_THREAD_HANDLE 0xFFFF8000
+#define CUR_PROCESS_HANDLE 0xFFFF8001
+
+typedef enum
+{
+	RESET_ONESHOT = 0,
+	RESET_STICKY = 1,
+	RESET_PULSE = 2,
+} ResetType;
+
+typedef enum
+{
+	USERBREAK_PANIC = 0,
+	USERBREAK_ASSERT = 1,
+	USERBREAK_USER = 2,
+} UserBreakType;
+
+typedef enum
+{
+	MEMOP_FREE = 1,
+	MEMOP_ALLOC = 3,
+	MEMOP_OP_MASK = 0xFF,
+} MemOp;
+
+typedef enum
+{
+	MEMPERM_READ = 1,
+	MEMPERM_WRITE = 2,
+	MEMPERM_EXECUTE = 4,
+} MemPerm;
+
+typedef struct
+{
+	u8 name[8];
+	u16 unk1;
+	u16 unk2;
+	u32 unk3;
+	u32 text_addr;
+	u32 text_size;
+	u32 ro_addr;
+	u32 ro_size;
+	u32 rw_addr;
+	u32 rw_size;
+	u32 text_size_total;
+	u32 ro_size_total;
+	u32 rw_size_total;
+	u32 unk4;
+	u64 program_id;
+} CodeSetInfo;
+
+Result svcControlMemory(u32* addr_out, u32 addr0, u32 addr1, u32 size, MemOp op, MemPerm perm);
+Result svcCreateCodeSet(Handle* out, const CodeSetInfo *info, void* code_ptr, void* ro_ptr, void* data_ptr);
+Result svcCreateProcess(Handle* out, Handle codeset, const u32 *arm11kernelcaps, u32 arm11kernelcaps_num);
+void svcExitProcess(void) __attribute__((noreturn));
+Result svcCreateThread(Handle* thread, ThreadFunc entrypoint, u32 arg, u32* stack_top, s32 thread_priority, s32 processor_id);
+void svcExitThread(void) __attribute__((noreturn));
+Result svcGetThreadPriority(s32 *out, Handle handle);
+void svcSleepThread(s64 ns);
+Result svcCreateEvent(Handle* event, ResetType reset_type);
+Result svcSignalEvent(Handle handle);
+Result svcClearEvent(Handle handle);
+Result svcCreateMutex(Handle* mutex, bool initially_locked);
+Result svcReleaseMutex(Handle handle);
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds);
+Result svcCloseHandle(Handle handle);
+u64 svcGetSystemTick(void);
+void svcBreak(UserBreakType breakReason);
+
+#define SYSCLOCK_ARM11 268111856
+
+// IPC, the command buffer is per thread like the console's TLS one
+
+#define IPC_MakeHeader(command_id,normal_params,translate_params) \
+	(((u32)(command_id) << 16) | (((u32)(normal_params) & 0x3F) << 6) | (((u32)(translate_params) & 0x3F) << 0))
+
+u32* getThreadCommandBuffer(void);
+Result svcSendSyncRequest(Handle session);
+Result svcAcceptSession(Handle* session, Handle port);
+Result svcReplyAndReceive(s32* index, const Handle* handles, s32 handleCount, Handle replyTarget);
+
+// filesystem
+
+typedef enum
+{
+	PATH_INVALID = 0,
+	PATH_EMPTY = 1,
+	PATH_BINARY = 2,
+	PATH_ASCII = 3,
+	PATH_UTF16 = 4,
+} FS_PathType;
+
+typedef enum
+{
+	ARCHIVE_SAVEDATA_AND_CONTENT2 = 0x2345678E,
+	ARCHIVE_SDMC = 0x00000009,
+	ARCHIVE_NAND_RW = 0x1234567D,
+} FS_ArchiveID;
+
+typedef enum
+{
+	MEDIATYPE_NAND = 0,
+	MEDIATYPE_SD = 1,
+	MEDIATYPE_GAME_CARD = 2,
+} FS_MediaType;
+
+enum
+{
+	FS_OPEN_READ = BIT(0),
+	FS_OPEN_WRITE = BIT(1),
+	FS_OPEN_CREATE = BIT(2),
+};
+
+enum
+{
+	FS_WRITE_FLUSH = BIT(0),
+	FS_WRITE_UPDATE_TIME = BIT(8),
+};
+
+typedef struct
+{
+	FS_PathType type;
+	u32 size;
+	const void* data;
+} FS_Path;
+
+typedef struct
+{
+	u32 id;
+	FS_Path lowPath;
+	u64 handle;
+} FS_Archive;
+
+typedef struct
+{
+	u64 programId;
+	FS_MediaType mediaType : 8;
+	u8 padding[7];
+} FS_ProgramInfo;
+
+Result FSFILE_Read(Handle handle, u32* bytesRead, u64 offset, void* buffer, u32 size);
+Result FSFILE_Write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size, u32 flags);
+Result FSFILE_GetSize(Handle handle, u64* size);
+Result FSFILE_SetSize(Handle handle, u64 size);
+Result FSFILE_Close(Handle handle);
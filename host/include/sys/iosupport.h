@@ -0,0 +1,6 @@
+/**
+ * @file iosupport.h
+ * @brief Host stand-in for the devkitARM header loader.c includes, nothing
+ * in it is used off-device.
+ */
+#pragma once
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "bench.h"
+#include "shim.h"
+#include "cmdstats.h"
+#include "exheader.h"
+#include "loader_run.h"
+
+// Runs the loader's own main() on a thread against the stand-in kernel and
+// services, and launches each title of a directory through it the way pm
+// does: RegisterProgram, GetProgramInfo, LoadProcess, UnregisterProgram.
+
+#define DEFAULT_RUNS 3
+#define DEFAULT_REQUEST_USEC 200
+#define DEFAULT_BYTES_PER_USEC 8
+#define MAX_TITLES 256
+
+enum
+{
+  STEP_REGISTER,
+  STEP_INFO,
+  STEP_LOAD,
+  STEP_UNREGISTER,
+  STEPS,
+};
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-n runs] [-l usec] [-b MB/s] [-r usec] [-s sd] titles [progid...]\n", prog);
+  fprintf(stderr, "  titles has a directory per program ID, in 16 hex digits, holding\n");
+  fprintf(stderr, "  exheader.bin and code.bin, without progids all of them are launched\n");
+  fprintf(stderr, "  -n  launches per title, the first one is cold (default %d)\n", DEFAULT_RUNS);
+  fprintf(stderr, "  -l  stand-in FS latency per read request (default %d)\n", DEFAULT_REQUEST_USEC);
+  fprintf(stderr, "  -b  stand-in FS bandwidth, 0 is unlimited (default %d)\n", DEFAULT_BYTES_PER_USEC);
+  fprintf(stderr, "  -r  stand-in fs:REG latency per request (default 0)\n");
+  fprintf(stderr, "  -s  directory standing in for SD, for /loader/ files, the loader's\n");
+  fprintf(stderr, "      command stats are written to its loader/cmdstats.bin at the end\n");
+}
+
+static int list_titles(const char *dir, u64 *progids, int max)
+{
+  DIR *d;
+  struct dirent *ent;
+  char *end;
+  int n;
+
+  d = opendir(dir);
+  if (d == NULL)
+  {
+    return -1;
+  }
+  n = 0;
+  while (n < max && (ent = readdir(d)) != NULL)
+  {
+    if (strlen(ent->d_name) == 16)
+    {
+      progids[n] = strtoull(ent->d_name, &end, 16);
+      if (*end == '\0')
+      {
+        n++;
+      }
+    }
+  }
+  closedir(d);
+  return n;
+}
+
+static int compare_progids(const void *a, const void *b)
+{
+  u64 x = *(const u64 *)a;
+  u64 y = *(const u64 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static Result request(Handle loader, u32 *cmdbuf, u64 *nsec)
+{
+  Result res;
+  u64 t0;
+
+  t0 = bench_nsec();
+  res = svcSendSyncRequest(loader);
+  *nsec = bench_nsec() - t0;
+  return R_FAILED(res) ? res : (Result)cmdbuf[1];
+}
+
+// one launch of progid, the process's segments are checksummed to *sum
+static Result launch(Handle loader, u64 progid, u64 *nsec, u32 *sum, u32 *size)
+{
+  const host_process *process;
+  FS_ProgramInfo info;
+  exheader_header exheader;
+  u64 prog_handle;
+  Handle handle;
+  u32 *cmdbuf;
+  Result res;
+
+  memset(&info, 0, sizeof(info));
+  info.programId = progid;
+  info.mediaType = MEDIATYPE_NAND;
+  cmdbuf = getThreadCommandBuffer();
+
+  cmdbuf[0] = IPC_MakeHeader(2, 8, 0); // RegisterProgram
+  memcpy(&cmdbuf[1], &info, sizeof(info));
+  memcpy(&cmdbuf[5], &info, sizeof(info));
+  res = request(loader, cmdbuf, &nsec[STEP_REGISTER]);
+  if (R_FAILED(res))
+  {
+    return res;
+  }
+  prog_handle = *(u64 *)&cmdbuf[2];
+
+  cmdbuf[0] = IPC_MakeHeader(4, 2, 0); // GetProgramInfo
+  *(u64 *)&cmdbuf[1] = prog_handle;
+  res = request(loader, cmdbuf, &nsec[STEP_INFO]);
+  if (R_SUCCEEDED(res))
+  {
+    // the static buffer comes back as the loader's own pointer
+    memcpy(&exheader, (const void *)(uintptr_t)cmdbuf[3], sizeof(exheader));
+
+    cmdbuf[0] = IPC_MakeHeader(1, 2, 0); // LoadProcess
+    *(u64 *)&cmdbuf[1] = prog_handle;
+    res = request(loader, cmdbuf, &nsec[STEP_LOAD]);
+  }
+  if (R_SUCCEEDED(res))
+  {
+    handle = cmdbuf[3];
+    process = host_process_get(handle);
+    if (process == NULL || process->info.program_id != exheader.arm11systemlocalcaps.programid)
+    {
+      res = -1;
+    }
+    else
+    {
+      *size = (process->info.text_size + process->info.ro_size + process->info.rw_size) << 12;
+      *sum = bench_checksum(process->text, *size);
+    }
+    svcCloseHandle(handle);
+  }
+
+  cmdbuf[0] = IPC_MakeHeader(3, 2, 0); // UnregisterProgram
+  *(u64 *)&cmdbuf[1] = prog_handle;
+  request(loader, cmdbuf, &nsec[STEP_UNREGISTER]);
+  return res;
+}
+
+static int bench_title(Handle loader, u64 progid, int runs)
+{
+  u64 best[STEPS];
+  u64 nsec[STEPS];
+  u64 first;
+  u64 total;
+  u64 best_total;
+  u32 first_sum;
+  u32 sum;
+  u32 size;
+  Result res;
+  int exact;
+  int run;
+  int i;
+
+  for (i = 0; i < STEPS; i++)
+  {
+    best[i] = ~0ULL;
+  }
+  first = 0;
+  best_total = ~0ULL;
+  first_sum = 0;
+  size = 0;
+  exact = 1;
+  for (run = 0; run < runs; run++)
+  {
+    memset(nsec, 0, sizeof(nsec));
+    res = launch(loader, progid, nsec, &sum, &size);
+    if (R_FAILED(res))
+    {
+      printf("%016llX failed: %08X\n", (unsigned long long)progid, (u32)res);
+      return -1;
+    }
+    total = 0;
+    for (i = 0; i < STEPS; i++)
+    {
+      best[i] = nsec[i] < best[i] ? nsec[i] : best[i];
+      total += nsec[i];
+    }
+    best_total = total < best_total ? total : best_total;
+    if (run == 0)
+    {
+      first = total;
+      first_sum = sum;
+    }
+    exact &= sum == first_sum;
+  }
+
+  printf("%016llX %9u %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f  %08X %s\n", (unsigned long long)progid, size,
+    best[STEP_REGISTER] / 1e6, best[STEP_INFO] / 1e6, best[STEP_LOAD] / 1e6, best[STEP_UNREGISTER] / 1e6,
+    first / 1e6, best_total / 1e6, first_sum, exact ? "ok" : "MISMATCH");
+  return exact ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+  host_fs_latency latency;
+  host_fsreg_latency reg_latency;
+  u64 progids[MAX_TITLES];
+  Handle thread;
+  Handle loader;
+  u32 *cmdbuf;
+  int sd;
+  int count;
+  int runs;
+  int failed;
+  int i;
+
+  runs = DEFAULT_RUNS;
+  sd = 0;
+  latency.request_usec = DEFAULT_REQUEST_USEC;
+  latency.bytes_per_usec = DEFAULT_BYTES_PER_USEC;
+  memset(&reg_latency, 0, sizeof(reg_latency));
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+    {
+      runs = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+    {
+      latency.request_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+    {
+      latency.bytes_per_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+    {
+      reg_latency.request_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+    {
+      host_fs_set_root(ARCHIVE_SDMC, argv[++i]);
+      sd = 1;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i >= argc || runs < 1)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  host_fsreg_set_titles(argv[i]);
+  if (i + 1 < argc)
+  {
+    for (count = 0; i + 1 < argc && count < MAX_TITLES; count++)
+    {
+      progids[count] = strtoull(argv[++i], NULL, 16);
+    }
+  }
+  else
+  {
+    count = list_titles(argv[i], progids, MAX_TITLES);
+    if (count < 0)
+    {
+      fprintf(stderr, "%s: cannot read\n", argv[i]);
+      return 1;
+    }
+    qsort(progids, count, sizeof(progids[0]), compare_progids);
+  }
+  host_fs_set_latency(&latency);
+  host_fsreg_set_latency(&reg_latency);
+
+  if (R_FAILED(loader_run_start(&thread, &loader)))
+  {
+    fprintf(stderr, "cannot start the loader\n");
+    return 1;
+  }
+
+  // times are the best of the runs per step, first is the cold launch
+  printf("%-16s %9s %8s %8s %8s %8s %8s %8s  %-8s %s\n", "title", "memory", "register", "info", "load",
+    "unreg", "first", "best", "fnv1a", "exact");
+  failed = 0;
+  for (i = 0; i < count; i++)
+  {
+    if (bench_title(loader, progids[i], runs) < 0)
+    {
+      failed = 1;
+    }
+  }
+
+  if (sd)
+  {
+    cmdbuf = getThreadCommandBuffer();
+    cmdbuf[0] = IPC_MakeHeader(0x103, 1, 0); // GetCommandStats
+    cmdbuf[1] = CMDSTATS_DUMP_SD;
+    svcSendSyncRequest(loader);
+  }
+  loader_run_stop(thread, loader);
+  return failed;
+}
@@ -0,0 +1,44 @@
+#include "shim.h"
+#include "srvsys.h"
+#include "loader_run.h"
+
+#define CONNECT_TRIES 1000
+
+// loader.c
+int loader_main(void);
+void __appInit(void);
+void __appExit(void);
+
+static void loader_thread(void *arg)
+{
+  __appInit();
+  loader_main();
+  __appExit();
+}
+
+Result loader_run_start(Handle *thread, Handle *session)
+{
+  Result res;
+  int tries;
+
+  res = svcCreateThread(thread, loader_thread, 0, NULL, 0x30, -2);
+  if (R_FAILED(res))
+  {
+    return res;
+  }
+  // until the loader has registered its service
+  for (tries = 0; R_FAILED(res = srvSysGetServiceHandle(session, "Loader")) && tries < CONNECT_TRIES; tries++)
+  {
+    svcSleepThread(1000000);
+  }
+  return res;
+}
+
+void loader_run_stop(Handle thread, Handle session)
+{
+  // the loader exits once it is asked to and its last session is closed
+  host_srv_notify(0x100);
+  svcCloseHandle(session);
+  svcWaitSynchronization(thread, U64_MAX);
+  svcCloseHandle(thread);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <3ds.h>
+
+// Runs loader.c, built with its main renamed to loader_main, on a thread of
+// the host tool against the stand-in kernel and services.
+
+// starts it and connects to its service
+Result loader_run_start(Handle *thread, Handle *session);
+// asks it to exit, closes the session and waits until it has
+void loader_run_stop(Handle thread, Handle session);
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "shim.h"
+#include "codeload.h"
+#include "lzblock.h"
+
+#define MIN_RUNS 5
+#define MIN_NSEC 200000000ULL
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-n runs] code.blk...\n", prog);
+  fprintf(stderr, "  each file is a block image as written by lzss_pack -b\n");
+}
+
+// one decode of the image in work, on one thread or through codeload
+static u64 time_decode(const u8 *image, u32 size, u8 *work, int parallel)
+{
+  lzblock_index index;
+  u64 t0;
+  u32 i;
+
+  memcpy(work, image, size);
+  t0 = bench_nsec();
+  if (parallel)
+  {
+    codeload_decompress(work, size);
+  }
+  else
+  {
+    lzblock_read_index(&index, work, size);
+    lzblock_place(&index, work);
+    for (i = 0; i < index.count; i++)
+    {
+      lzblock_decode(&index, work, i);
+    }
+  }
+  return bench_nsec() - t0;
+}
+
+static int bench_file(const char *path, int runs)
+{
+  lzblock_index index;
+  u8 *image;
+  u8 *work;
+  u32 size;
+  u32 outsize;
+  u32 serial_sum;
+  u64 best[2];
+  u64 begin;
+  u64 t;
+  int parallel;
+  int run;
+
+  image = bench_load_file(path, &size, 0);
+  if (image == NULL)
+  {
+    fprintf(stderr, "%s: cannot read\n", path);
+    return -1;
+  }
+  if (!lzblock_read_index(&index, image, size))
+  {
+    fprintf(stderr, "%s: not a block image\n", path);
+    free(image);
+    return -1;
+  }
+  outsize = index.image_size > size ? index.image_size : size;
+  work = bench_alloc_low(outsize);
+
+  serial_sum = 0;
+  for (parallel = 0; parallel < 2; parallel++)
+  {
+    best[parallel] = ~0ULL;
+    begin = bench_nsec();
+    for (run = 0; run < runs || (runs == 0 && (run < MIN_RUNS || bench_nsec() - begin < MIN_NSEC)); run++)
+    {
+      t = time_decode(image, size, work, parallel);
+      if (t < best[parallel])
+      {
+        best[parallel] = t;
+      }
+    }
+    if (!parallel)
+    {
+      serial_sum = bench_checksum(work, index.image_size);
+    }
+  }
+
+  printf("%-32s %9u %6u %9.3f %9.3f %7.2fx  %08X %s\n", path, index.image_size, index.count,
+    best[0] / 1e6, best[1] / 1e6, (double)best[0] / best[1], serial_sum,
+    bench_checksum(work, index.image_size) == serial_sum ? "ok" : "MISMATCH");
+  t = bench_checksum(work, index.image_size) != serial_sum;
+  bench_free_low(work, outsize);
+  free(image);
+  return t ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int runs;
+  int failed;
+  int i;
+
+  runs = 0;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+    {
+      runs = atoi(argv[++i]);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i >= argc)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // serial decodes the blocks in order on this thread, codeload splits them
+  // between two threads the way the loader does
+  printf("%-32s %9s %6s %9s %9s %8s  %-8s %s\n", "image", "unpacked", "blocks", "serial", "codeload", "speedup", "fnv1a", "exact");
+  failed = 0;
+  for (; i < argc; i++)
+  {
+    if (bench_file(argv[i], runs) < 0)
+    {
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "lzss.h"
+
+#define MIN_RUNS 5
+#define MIN_NSEC 200000000ULL
+
+typedef struct
+{
+  u64 nsec;
+  u64 cycles;
+} sample_t;
+
+typedef int (*decoder_t)(u8 *end);
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-n runs] [-r] code.bin...\n", prog);
+  fprintf(stderr, "  each file is a compressed .code image as stored in ExeFS\n");
+  fprintf(stderr, "  -r  time the bytewise reference decoder instead\n");
+}
+
+// returns the decompressed size or 0 if the footer is not sane
+static u32 footer_check(const u8 *buf, u32 size)
+{
+  u32 info;
+  u32 hdrlen;
+  u32 compsize;
+  u32 addsize;
+
+  if (size < 8)
+  {
+    return 0;
+  }
+  memcpy(&info, buf + size - 8, 4);
+  memcpy(&addsize, buf + size - 4, 4);
+  hdrlen = info >> 24;
+  compsize = info & 0xFFFFFF;
+  if (hdrlen < 8 || hdrlen > compsize || compsize > size)
+  {
+    return 0;
+  }
+  return size + addsize;
+}
+
+static int bench_file(const char *path, decoder_t decode, int runs, u64 *total_out, sample_t *total)
+{
+  u8 *packed;
+  u8 *work;
+  u8 *check;
+  u32 size;
+  u32 outsize;
+  u32 sum;
+  sample_t best;
+  u64 spent;
+  u64 t0, c0, t1, c1;
+  int i;
+
+  packed = bench_load_file(path, &size, 0);
+  if (packed == NULL)
+  {
+    fprintf(stderr, "%s: cannot read\n", path);
+    return -1;
+  }
+  outsize = footer_check(packed, size);
+  if (outsize == 0)
+  {
+    fprintf(stderr, "%s: not a backwards LZSS image\n", path);
+    free(packed);
+    return -1;
+  }
+  work = malloc(outsize);
+  check = malloc(outsize);
+  if (work == NULL || check == NULL)
+  {
+    free(work);
+    free(check);
+    free(packed);
+    return -1;
+  }
+
+  // the reference output every decoder has to reproduce exactly
+  memcpy(check, packed, size);
+  lzss_decompress_bytewise(check + size);
+
+  best.nsec = ~0ULL;
+  best.cycles = ~0ULL;
+  spent = 0;
+  for (i = 0; i < runs || (runs == 0 && (i < MIN_RUNS || spent < MIN_NSEC)); i++)
+  {
+    memcpy(work, packed, size);
+    t0 = bench_nsec();
+    c0 = bench_cycles();
+    decode(work + size);
+    c1 = bench_cycles();
+    t1 = bench_nsec();
+    spent += t1 - t0;
+    if (t1 - t0 < best.nsec)
+    {
+      best.nsec = t1 - t0;
+    }
+    if (c1 - c0 < best.cycles)
+    {
+      best.cycles = c1 - c0;
+    }
+  }
+  sum = bench_checksum(work, outsize);
+
+  printf("%-32s %9u %9u %5d %9.1f", path, size, outsize, i, outsize / (best.nsec / 1e3));
+  if (BENCH_HAVE_CYCLES)
+  {
+    printf(" %7.3f", (double)outsize / best.cycles);
+  }
+  else
+  {
+    printf(" %7s", "n/a");
+  }
+  printf("  %08X %s\n", sum, memcmp(work, check, outsize) ? "MISMATCH" : "ok");
+
+  *total_out += outsize;
+  total->nsec += best.nsec;
+  total->cycles += best.cycles;
+  i = memcmp(work, check, outsize);
+  free(check);
+  free(work);
+  free(packed);
+  return i ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int runs;
+  int i;
+  int failed;
+  decoder_t decode;
+  u64 total_out;
+  sample_t total;
+
+  runs = 0;
+  decode = lzss_decompress;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+    {
+      runs = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-r") == 0)
+    {
+      decode = lzss_decompress_bytewise;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i >= argc)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  printf("%-32s %9s %9s %5s %9s %7s  %-8s %s\n", "image", "packed", "unpacked", "runs", "MB/s", "B/cyc", "fnv1a", "exact");
+  failed = 0;
+  total_out = 0;
+  memset(&total, 0, sizeof(total));
+  for (; i < argc; i++)
+  {
+    if (bench_file(argv[i], decode, runs, &total_out, &total) < 0)
+    {
+      failed = 1;
+    }
+  }
+  if (total.nsec > 0)
+  {
+    printf("%-32s %9s %9llu %5s %9.1f", "total", "", (unsigned long long)total_out, "", total_out / (total.nsec / 1e3));
+    if (BENCH_HAVE_CYCLES)
+    {
+      printf(" %7.3f", (double)total_out / total.cycles);
+    }
+    printf("\n");
+  }
+  return failed;
+}
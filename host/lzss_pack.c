@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "lzblock.h"
+#include "lzss.h"
+
+// Produces the backwards LZSS images lzss_decompress reads, see lzss.c for
+// the stream layout. The image is compressed as if it were reversed, then
+// the longest prefix of tokens that still decodes in place is kept and the
+// rest of the image is stored raw in front of it. With -b it writes a block
+// image instead, see lzblock.c.
+
+#define MIN_LEN 3
+#define MAX_LEN 18
+#define MIN_DIST 3
+#define MAX_DIST 4098
+#define HASH_BITS 16
+#define FOOTER_SIZE 8
+#define TIMING_RUNS 20
+
+typedef struct
+{
+  const char *name;
+  int min_match; // shortest back-reference worth a token
+  int min_dist;  // shortest distance, 4 keeps every copy on the word path
+  int chain;     // hash chain candidates examined per position
+} pack_opts;
+
+static const pack_opts g_size_opts = { "size", MIN_LEN, MIN_DIST, 256 };
+static const pack_opts g_speed_opts = { "speed", 6, 4, 256 };
+
+typedef struct
+{
+  u32 packed;
+  u64 decode_nsec;
+} pack_result;
+
+static u32 hash3(const u8 *p)
+{
+  return (((u32)p[0] << 16 | (u32)p[1] << 8 | p[2]) * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// returns the packed image or NULL if nothing could be gained
+static u8 *pack(const u8 *in, u32 size, const pack_opts *opts, u32 *out_size)
+{
+  u8 *rev;
+  u8 *enc;
+  u8 *out;
+  s32 *head;
+  s32 *prev;
+  u32 i, k, c, flag_at, bits;
+  u32 best_c, best_o;
+  s64 best_gain;
+  u32 len, dist, best_len, best_dist;
+  u32 pad, hdrlen, raw, total;
+  s32 p;
+  int depth;
+
+  rev = malloc(size + MAX_LEN);
+  enc = malloc(size + size / 8 + 16);
+  head = malloc(sizeof(s32) << HASH_BITS);
+  prev = malloc(sizeof(s32) * (size + 1));
+  for (i = 0; i < size; i++)
+  {
+    rev[i] = in[size - 1 - i];
+  }
+  memset(head, 0xFF, sizeof(s32) << HASH_BITS);
+
+  c = 0;
+  bits = 0;
+  flag_at = 0;
+  best_c = 0;
+  best_o = 0;
+  best_gain = 0;
+  i = 0;
+  while (i < size)
+  {
+    if (bits == 0)
+    {
+      flag_at = c;
+      enc[c++] = 0;
+      bits = 8;
+    }
+    bits--;
+
+    best_len = 0;
+    best_dist = 0;
+    if (i + MIN_LEN <= size)
+    {
+      depth = opts->chain;
+      for (p = head[hash3(rev + i)]; p >= 0 && depth > 0; p = prev[p], depth--)
+      {
+        dist = i - p;
+        if (dist > MAX_DIST)
+        {
+          break;
+        }
+        if (dist < (u32)opts->min_dist)
+        {
+          continue;
+        }
+        for (len = 0; len < MAX_LEN && i + len < size && rev[p + len] == rev[i + len]; len++);
+        if (len > best_len)
+        {
+          best_len = len;
+          best_dist = dist;
+          if (len == MAX_LEN)
+          {
+            break;
+          }
+        }
+      }
+    }
+
+    if (best_len < (u32)opts->min_match)
+    {
+      best_len = 1;
+      enc[c++] = rev[i];
+    }
+    else
+    {
+      enc[flag_at] |= 1 << bits;
+      enc[c++] = ((best_len - 3) << 4) | ((best_dist - 3) >> 8);
+      enc[c++] = (best_dist - 3) & 0xFF;
+    }
+    for (k = 0; k < best_len; k++, i++)
+    {
+      if (i + MIN_LEN <= size)
+      {
+        p = hash3(rev + i);
+        prev[i] = head[p];
+        head[p] = i;
+      }
+    }
+
+    // keeping the tokens so far saves i - c bytes, and is safe in place as
+    // long as no earlier prefix saved more
+    if ((s64)i - c > best_gain)
+    {
+      best_gain = (s64)i - c;
+      best_c = c;
+      best_o = i;
+    }
+  }
+
+  free(prev);
+  free(head);
+  free(rev);
+
+  raw = size - best_o;
+  pad = (4 - ((raw + best_c) & 3)) & 3;
+  hdrlen = FOOTER_SIZE + pad;
+  if (best_gain <= hdrlen)
+  {
+    free(enc);
+    return NULL;
+  }
+  total = raw + best_c + hdrlen;
+  out = malloc(size > total ? size : total);
+  memcpy(out, in, raw);
+  for (k = 0; k < best_c; k++)
+  {
+    out[raw + k] = enc[best_c - 1 - k];
+  }
+  memset(out + raw + best_c, 0xFF, pad);
+  k = (hdrlen << 24) | (best_c + hdrlen);
+  memcpy(out + total - 8, &k, 4);
+  k = size - total;
+  memcpy(out + total - 4, &k, 4);
+  free(enc);
+
+  *out_size = total;
+  return out;
+}
+
+// packs with the given options, checks the image round-trips and times it
+static u8 *pack_checked(const u8 *in, u32 size, const pack_opts *opts, pack_result *result)
+{
+  u8 *out;
+  u8 *work;
+  u64 t0;
+  u64 t;
+  int run;
+
+  out = pack(in, size, opts, &result->packed);
+  if (out == NULL)
+  {
+    return NULL;
+  }
+  work = malloc(size);
+  result->decode_nsec = ~0ULL;
+  for (run = 0; run < TIMING_RUNS; run++)
+  {
+    memcpy(work, out, result->packed);
+    t0 = bench_nsec();
+    lzss_decompress(work + result->packed);
+    t = bench_nsec() - t0;
+    if (t < result->decode_nsec)
+    {
+      result->decode_nsec = t;
+    }
+  }
+  if (memcmp(work, in, size) != 0)
+  {
+    fprintf(stderr, "internal error: %s image does not round-trip\n", opts->name);
+    exit(2);
+  }
+  free(work);
+  return out;
+}
+
+// packs every block on its own, blocks that do not compress are stored
+static u8 *pack_blocks(const u8 *in, u32 size, const pack_opts *opts, u32 block_size, u32 *out_size)
+{
+  lzblock_footer footer;
+  lzblock_index index;
+  u32 sizes[LZBLOCK_MAX];
+  u8 *out;
+  u8 *block;
+  u8 *work;
+  u32 len;
+  u32 packed;
+  u32 total;
+  u32 i;
+
+  footer.image_size = size;
+  footer.block_size = block_size;
+  footer.count = (size + block_size - 1) / block_size;
+  footer.magic = LZBLOCK_MAGIC;
+  if (footer.count > LZBLOCK_MAX)
+  {
+    return NULL;
+  }
+  out = malloc(size + sizeof(sizes) + sizeof(footer));
+  total = 0;
+  for (i = 0; i < footer.count; i++)
+  {
+    len = size - i * block_size < block_size ? size - i * block_size : block_size;
+    block = pack(in + i * block_size, len, opts, &packed);
+    if (block == NULL)
+    {
+      memcpy(out + total, in + i * block_size, len);
+      sizes[i] = len | LZBLOCK_RAW;
+      total += len;
+    }
+    else
+    {
+      memcpy(out + total, block, packed);
+      sizes[i] = packed;
+      total += packed;
+      free(block);
+    }
+  }
+  memcpy(out + total, sizes, footer.count * 4);
+  total += footer.count * 4;
+  memcpy(out + total, &footer, sizeof(footer));
+  total += sizeof(footer);
+
+  // decode it the way the loader does, one block after the other
+  work = malloc(total > size ? total : size);
+  memcpy(work, out, total);
+  if (!lzblock_read_index(&index, work, total))
+  {
+    fprintf(stderr, "internal error: block image has no valid index\n");
+    exit(2);
+  }
+  lzblock_place(&index, work);
+  for (i = 0; i < index.count; i++)
+  {
+    lzblock_decode(&index, work, i);
+  }
+  if (memcmp(work, in, size) != 0)
+  {
+    fprintf(stderr, "internal error: block image does not round-trip\n");
+    exit(2);
+  }
+  free(work);
+  *out_size = total;
+  return out;
+}
+
+static void print_result(const pack_opts *opts, u32 size, const pack_result *result)
+{
+  printf("%-8s %4d %4d %9u %6.1f%% %9.3f %9.1f\n", opts->name, opts->min_match, opts->min_dist,
+    result->packed, 100.0 * result->packed / size,
+    result->decode_nsec / 1e6, size / (result->decode_nsec / 1e3));
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-s | -f] [-m len] [-d dist] [-t] [-b size] code.bin [out.bin]\n", prog);
+  fprintf(stderr, "  -s  smallest output (default)\n");
+  fprintf(stderr, "  -f  fast decode: fewer, longer matches and longer literal runs\n");
+  fprintf(stderr, "  -m  shortest match to encode (%d-%d)\n", MIN_LEN, MAX_LEN);
+  fprintf(stderr, "  -d  shortest match distance (%d-%d)\n", MIN_DIST, MAX_DIST);
+  fprintf(stderr, "  -t  print the size against decode time for a range of settings\n");
+  fprintf(stderr, "  -b  write a block image of blocks this many bytes long (a multiple of 4,\n");
+  fprintf(stderr, "      at most %d blocks), the loader decodes them on two cores\n", LZBLOCK_MAX);
+}
+
+int main(int argc, char *argv[])
+{
+  pack_opts opts;
+  pack_opts sweep;
+  pack_result base;
+  pack_result result;
+  u8 *in;
+  u8 *out;
+  u32 size;
+  u32 block_size;
+  u32 packed;
+  FILE *fp;
+  int tradeoff;
+  int i;
+
+  opts = g_size_opts;
+  tradeoff = 0;
+  block_size = 0;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "-s") == 0)
+    {
+      opts = g_size_opts;
+    }
+    else if (strcmp(argv[i], "-f") == 0)
+    {
+      opts = g_speed_opts;
+    }
+    else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+    {
+      opts.name = "custom";
+      opts.min_match = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+    {
+      opts.name = "custom";
+      opts.min_dist = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-t") == 0)
+    {
+      tradeoff = 1;
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+    {
+      block_size = strtoul(argv[++i], NULL, 0);
+      if (block_size == 0 || (block_size & 3) != 0)
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i >= argc || opts.min_match < MIN_LEN || opts.min_match > MAX_LEN ||
+      opts.min_dist < MIN_DIST || opts.min_dist > MAX_DIST)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  in = bench_load_file(argv[i], &size, 0);
+  if (in == NULL)
+  {
+    fprintf(stderr, "%s: cannot read\n", argv[i]);
+    return 1;
+  }
+
+  printf("%-8s %4s %4s %9s %7s %9s %9s\n", "mode", "len", "dist", "packed", "ratio", "dec ms", "MB/s");
+  out = pack_checked(in, size, &g_size_opts, &base);
+  if (out == NULL)
+  {
+    fprintf(stderr, "%s: does not compress, store it uncompressed instead\n", argv[i]);
+    return 1;
+  }
+  free(out);
+  print_result(&g_size_opts, size, &base);
+
+  if (tradeoff)
+  {
+    sweep = g_size_opts;
+    sweep.name = "sweep";
+    for (sweep.min_dist = MIN_DIST; sweep.min_dist <= 4; sweep.min_dist++)
+    {
+      for (sweep.min_match = MIN_LEN; sweep.min_match <= 10; sweep.min_match++)
+      {
+        out = pack_checked(in, size, &sweep, &result);
+        if (out != NULL)
+        {
+          print_result(&sweep, size, &result);
+          free(out);
+        }
+      }
+    }
+  }
+
+  out = pack_checked(in, size, &opts, &result);
+  if (out == NULL)
+  {
+    fprintf(stderr, "%s: does not compress with these settings\n", argv[i]);
+    return 1;
+  }
+  if (opts.name != g_size_opts.name)
+  {
+    print_result(&opts, size, &result);
+  }
+  packed = result.packed;
+
+  if (block_size != 0)
+  {
+    free(out);
+    out = pack_blocks(in, size, &opts, block_size, &packed);
+    if (out == NULL)
+    {
+      fprintf(stderr, "%s: more than %d blocks of %u bytes\n", argv[i], LZBLOCK_MAX, block_size);
+      return 1;
+    }
+    printf("%u blocks of %u bytes: %u packed, %.1f%%\n", (size + block_size - 1) / block_size,
+      block_size, packed, 100.0 * packed / size);
+  }
+
+  if (i + 1 < argc)
+  {
+    fp = fopen(argv[i + 1], "wb");
+    if (fp == NULL || fwrite(out, 1, packed, fp) != packed)
+    {
+      fprintf(stderr, "%s: cannot write\n", argv[i + 1]);
+      return 1;
+    }
+    fclose(fp);
+  }
+  free(out);
+  free(in);
+  return 0;
+}
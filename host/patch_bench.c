@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "shim.h"
+#include "patcher.h"
+
+#define MIN_RUNS 5
+#define MIN_NSEC 100000000ULL
+
+typedef struct
+{
+  const char *name;
+  u64 progid;
+} title_t;
+
+// one title for every patch set in patcher.c
+static const title_t g_titles[] =
+{
+  { "menu", 0x0004003000008F02LL },
+  { "nim", 0x0004013000002C02LL },
+  { "ns", 0x0004013000008002LL },
+  { "cfg", 0x0004013000001702LL },
+};
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-n runs] [-s sdroot] [-t title] [-g text,ro,data] code.raw...\n", prog);
+  fprintf(stderr, "  each file is a decompressed code image\n");
+  fprintf(stderr, "  -g  segment sizes in bytes as in the exheader, without it the whole\n");
+  fprintf(stderr, "      image is text and patches on ro or data find nothing\n");
+  fprintf(stderr, "  -s  directory standing in for SD and NAND, patching reads SecureInfo_A\n");
+  fprintf(stderr, "      from it and writes sys/SecureInfo_C\n");
+  fprintf(stderr, "  -t  only patch as this title (menu, nim, ns, cfg or a program ID in hex,\n");
+  fprintf(stderr, "      for patches from the patches.bin in the -s directory)\n");
+}
+
+// lays the segments out in `work` the way load_code maps them, each one
+// starting on a page
+static void make_segments(u8 *work, u32 size, const u32 *segs, exheader_codesetinfo *codeset, prog_addrs_t *shared)
+{
+  memset(codeset, 0, sizeof(*codeset));
+  codeset->text.codesize = segs[0];
+  codeset->ro.codesize = segs[1];
+  codeset->data.codesize = segs[2];
+  if (segs[0] + segs[1] + segs[2] == 0)
+  {
+    codeset->text.codesize = size;
+  }
+  shared->text_addr = (u32)work;
+  shared->text_size = (codeset->text.codesize + 4095) >> 12;
+  shared->ro_addr = shared->text_addr + (shared->text_size << 12);
+  shared->ro_size = (codeset->ro.codesize + 4095) >> 12;
+  shared->data_addr = shared->ro_addr + (shared->ro_size << 12);
+  shared->data_size = (codeset->data.codesize + 4095) >> 12;
+  shared->total_size = shared->text_size + shared->ro_size + shared->data_size;
+}
+
+static void bench_title(const char *path, const u8 *image, u32 size, u8 *work,
+  const prog_addrs_t *shared, const exheader_codesetinfo *codeset, const title_t *title, int runs)
+{
+  u64 first;
+  u64 best;
+  u64 begin;
+  u64 t0;
+  u64 t;
+  u32 changed;
+  u32 i;
+  int run;
+
+  first = 0;
+  best = ~0ULL;
+  begin = bench_nsec();
+  // the budget includes restoring the image, which a cheap patch is dwarfed by
+  for (run = 0; run < runs || (runs == 0 && (run < MIN_RUNS || bench_nsec() - begin < MIN_NSEC)); run++)
+  {
+    memcpy(work, image, size);
+    t0 = bench_nsec();
+    patch_code(title->progid, shared, codeset);
+    t = bench_nsec() - t0;
+    if (run == 0)
+    {
+      first = t;
+    }
+    if (t < best)
+    {
+      best = t;
+    }
+  }
+  changed = 0;
+  for (i = 0; i < size; i++)
+  {
+    changed += work[i] != image[i];
+  }
+  printf("%-32s %-5s %5d %9.3f %9.3f %9.1f %7u  %08X\n", path, title->name, run,
+    first / 1e6, best / 1e6, size / (best / 1e3), changed, bench_checksum(work, size));
+}
+
+int main(int argc, char *argv[])
+{
+  exheader_codesetinfo codeset;
+  prog_addrs_t shared;
+  title_t title;
+  unsigned long long progid;
+  const char *only;
+  u32 segs[3];
+  u8 *image;
+  u8 *work;
+  u32 size;
+  int runs;
+  int found;
+  int i;
+  int t;
+
+  runs = 0;
+  only = NULL;
+  memset(segs, 0, sizeof(segs));
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+    {
+      runs = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+    {
+      host_fs_set_root(ARCHIVE_SDMC, argv[++i]);
+      host_fs_set_root(ARCHIVE_NAND_RW, argv[i]);
+    }
+    else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+    {
+      if (sscanf(argv[++i], "%i,%i,%i", &segs[0], &segs[1], &segs[2]) != 3)
+      {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      only = argv[++i];
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i >= argc)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // every run scans, with PATCH_SITES_ENABLE=1 the first run scans unless
+  // the sites are on SD already and later runs patch the recorded sites
+  printf("%-32s %-5s %5s %9s %9s %9s %7s  %s\n", "image", "title", "runs", "first ms", "ms", "MB/s", "changed", "fnv1a");
+  found = 0;
+  for (; i < argc; i++)
+  {
+    image = bench_load_file(argv[i], &size, 0);
+    if (image == NULL)
+    {
+      fprintf(stderr, "%s: cannot read\n", argv[i]);
+      return 1;
+    }
+    make_segments(NULL, size, segs, &codeset, &shared);
+    if (shared.total_size << 12 < size)
+    {
+      fprintf(stderr, "%s: larger than its segments\n", argv[i]);
+      return 1;
+    }
+    work = bench_alloc_low(shared.total_size << 12);
+    make_segments(work, size, segs, &codeset, &shared);
+    memset(work + size, 0, (shared.total_size << 12) - size);
+    for (t = 0; t < sizeof(g_titles) / sizeof(g_titles[0]); t++)
+    {
+      if (only == NULL || strcmp(only, g_titles[t].name) == 0)
+      {
+        bench_title(argv[i], image, size, work, &shared, &codeset, &g_titles[t], runs);
+        found = 1;
+      }
+    }
+    if (!found && only != NULL && sscanf(only, "%llx", &progid) == 1)
+    {
+      title.name = only;
+      title.progid = progid;
+      bench_title(argv[i], image, size, work, &shared, &codeset, &title, runs);
+      found = 1;
+    }
+    bench_free_low(work, shared.total_size << 12);
+    free(image);
+  }
+  if (!found)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  return 0;
+}
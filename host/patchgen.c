@@ -0,0 +1,191 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "patchset.h"
+
+// Build-time generator for patch_tables.h: reads the patch sets in
+// patches.def and writes the patterns, replacements and search tables of
+// every set as const data for patcher.c. Runs on the build machine for both
+// the console and the host build, linked with source/patchset.c.
+
+typedef struct
+{
+  const char *set;
+  const char *name;
+  const char *segment;
+  int offset;
+  int count;
+  const u8 *pattern;
+  u32 patsize;
+  const u8 *replace;
+  u32 repsize;
+} patch_def;
+
+#define PATTERN(...) __VA_ARGS__
+#define REPLACE(...) __VA_ARGS__
+#define PATCH(set, name, segment, offset, count, pattern, replace) \
+  { #set, #name, #segment, offset, count, \
+    (const u8[]){ pattern }, sizeof((const u8[]){ pattern }), \
+    (const u8[]){ replace }, sizeof((const u8[]){ replace }) },
+
+static const patch_def g_defs[] =
+{
+#include "patches.def"
+};
+
+#define DEF_COUNT (sizeof(g_defs) / sizeof(g_defs[0]))
+
+static const char *const g_segments[PATCH_SEGMENTS] = { "text", "ro", "data", "all" };
+
+static int segment_index(const char *name)
+{
+  int i;
+
+  for (i = 0; i < PATCH_SEGMENTS; i++)
+  {
+    if (strcmp(name, g_segments[i]) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void print_upper(const char *s)
+{
+  for (; *s; s++)
+  {
+    putchar(toupper((unsigned char)*s));
+  }
+}
+
+static void print_bytes(const char *indent, const u8 *data, u32 size)
+{
+  u32 i;
+
+  for (i = 0; i < size; i++)
+  {
+    printf("%s0x%02X%s", i % 16 == 0 ? indent : "", data[i],
+      i + 1 == size ? "\n" : i % 16 == 15 ? ",\n" : ", ");
+  }
+}
+
+static int emit_set(const char *name)
+{
+  const patch_def *defs[PATCH_MAX];
+  const patch_def *def;
+  patch_t patches[PATCH_MAX];
+  u8 segments[PATCH_MAX];
+  patch_scan scan[PATCH_SEGMENTS];
+  u8 next[PATCH_MAX];
+  u32 n;
+  u32 i;
+  int seg;
+
+  n = 0;
+  for (i = 0; i < DEF_COUNT; i++)
+  {
+    def = &g_defs[i];
+    if (strcmp(def->set, name) != 0)
+    {
+      continue;
+    }
+    if (n == PATCH_MAX || def->patsize < PATCH_MIN_LEN || def->count < 1 || def->count > PATCH_HITS ||
+        segment_index(def->segment) < 0)
+    {
+      fprintf(stderr, "patches.def: %s.%s: needs a pattern of %d bytes or more, a count of 1 to %d, "
+        "a segment of text, ro, data or all and at most %d patches per set\n",
+        def->set, def->name, PATCH_MIN_LEN, PATCH_HITS, PATCH_MAX);
+      return -1;
+    }
+    patches[n].pattern = def->pattern;
+    patches[n].patsize = def->patsize;
+    segments[n] = segment_index(def->segment);
+    defs[n++] = def;
+  }
+  memset(next, NO_PATCH, sizeof(next));
+  for (seg = 0; seg < PATCH_SEGMENTS; seg++)
+  {
+    patch_make_scan(&scan[seg], next, patches, segments, n, seg);
+  }
+
+  printf("// %s\n\nenum\n{\n", name);
+  for (i = 0; i < n; i++)
+  {
+    printf("  PATCH_");
+    print_upper(name);
+    printf("_");
+    print_upper(defs[i]->name);
+    printf(" = %u,\n", i);
+  }
+  printf("};\n\n");
+
+  for (i = 0; i < n; i++)
+  {
+    def = defs[i];
+    printf("static const u8 patch_%s_%s_pattern[] =\n{\n", name, def->name);
+    print_bytes("  ", def->pattern, def->patsize);
+    printf("};\n\nstatic const u8 patch_%s_%s_replace[] =\n{\n", name, def->name);
+    print_bytes("  ", def->replace, def->repsize);
+    printf("};\n\n");
+  }
+
+  printf("static const patch_t patch_%s_patches[] =\n{\n", name);
+  for (i = 0; i < n; i++)
+  {
+    def = defs[i];
+    printf("  { patch_%s_%s_pattern, %u, %d, patch_%s_%s_replace, %u, %d },\n",
+      name, def->name, def->patsize, def->offset, name, def->name, def->repsize, def->count);
+  }
+  printf("};\n\n");
+
+  for (seg = 0; seg < PATCH_SEGMENTS; seg++)
+  {
+    if (scan[seg].n == 0)
+    {
+      continue;
+    }
+    printf("static const patch_scan patch_%s_%s_scan =\n{\n", name, g_segments[seg]);
+    printf("  %u, %u, %u,\n  {\n", scan[seg].n, scan[seg].winlen, scan[seg].maxlen);
+    print_bytes("    ", scan[seg].shift, sizeof(scan[seg].shift));
+    printf("  },\n  {\n");
+    print_bytes("    ", scan[seg].head, sizeof(scan[seg].head));
+    printf("  }\n};\n\n");
+  }
+
+  printf("static const patch_set patch_set_%s =\n{\n  %u,\n  {\n", name, n);
+  print_bytes("    ", next, sizeof(next));
+  printf("  },\n  patch_%s_patches,\n  {", name);
+  for (seg = 0; seg < PATCH_SEGMENTS; seg++)
+  {
+    if (scan[seg].n == 0)
+    {
+      printf(" NULL");
+    }
+    else
+    {
+      printf(" &patch_%s_%s_scan", name, g_segments[seg]);
+    }
+    printf(seg + 1 < PATCH_SEGMENTS ? "," : " }\n};\n\n");
+  }
+  return 0;
+}
+
+int main(void)
+{
+  u32 i;
+  u32 j;
+
+  printf("// generated by host/patchgen.c from source/patches.def, do not edit\n\n");
+  printf("#pragma once\n\n#include \"patchset.h\"\n\n");
+  for (i = 0; i < DEF_COUNT; i++)
+  {
+    // each set is emitted where its first patch is defined
+    for (j = 0; j < i && strcmp(g_defs[j].set, g_defs[i].set) != 0; j++);
+    if (j == i && emit_set(g_defs[i].set) < 0)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
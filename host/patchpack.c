@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "patchfile.h"
+
+// Builds the /loader/patches.bin the loader reads patches from, see
+// patchfile.h. The input is text, one statement per line, # starts a comment:
+//
+//   titles 0004013000002C02 0004013000002C03
+//   patch text 0 1 25 79 0B 99 = E3 A0
+//
+// titles starts a set that applies to the listed program IDs, the patches
+// after it up to the next titles belong to it. A patch gives its segment
+// (text, ro or data, or all for one search from text to the end of data),
+// the offset of the replacement from the start of a match, how many matches
+// are patched, then the pattern and the replacement in hex bytes.
+
+#define MAX_TITLES 256
+#define MAX_SETS 64
+#define MAX_PATCHES 256
+#define MAX_DATA 0x4000
+#define LINE_MAX 1024
+
+typedef struct
+{
+  patchfile_title titles[MAX_TITLES];
+  patchfile_set sets[MAX_SETS];
+  patchfile_patch patches[MAX_PATCHES];
+  u8 data[MAX_DATA];
+  u32 ntitles;
+  u32 nsets;
+  u32 npatches;
+  u32 data_size;
+} pack_t;
+
+static pack_t g_pack;
+
+static const char *const g_segments[PATCH_SEGMENTS] = { "text", "ro", "data", "all" };
+
+static int fail(const char *path, int line, const char *msg)
+{
+  fprintf(stderr, "%s:%d: %s\n", path, line, msg);
+  return -1;
+}
+
+// reads hex bytes up to `stop` or the end of the line, returns how many
+static int parse_bytes(char **save, const char *stop, u8 *out, int max)
+{
+  char *tok;
+  char *end;
+  unsigned long v;
+  int n;
+
+  n = 0;
+  while ((tok = strtok_r(NULL, " \t\r\n", save)) != NULL)
+  {
+    if (stop != NULL && strcmp(tok, stop) == 0)
+    {
+      return n;
+    }
+    v = strtoul(tok, &end, 16);
+    if (*end != '\0' || v > 0xFF || n == max)
+    {
+      return -1;
+    }
+    out[n++] = (u8)v;
+  }
+  return stop == NULL ? n : -1;
+}
+
+static int parse_patch(char **save, const char *path, int line)
+{
+  patchfile_patch *patch;
+  patchfile_set *set;
+  u8 pattern[0xFF];
+  u8 replace[0xFF];
+  char *tok;
+  char *end;
+  int patsize;
+  int repsize;
+  int seg;
+  long v;
+
+  if (g_pack.nsets == 0)
+  {
+    return fail(path, line, "patch before the first titles");
+  }
+  set = &g_pack.sets[g_pack.nsets - 1];
+  if (set->count == PATCH_MAX || g_pack.npatches == MAX_PATCHES)
+  {
+    return fail(path, line, "too many patches");
+  }
+  patch = &g_pack.patches[g_pack.npatches];
+
+  tok = strtok_r(NULL, " \t\r\n", save);
+  for (seg = 0; seg < PATCH_SEGMENTS && (tok == NULL || strcmp(tok, g_segments[seg]) != 0); seg++);
+  if (seg == PATCH_SEGMENTS)
+  {
+    return fail(path, line, "segment must be text, ro, data or all");
+  }
+  patch->segment = seg;
+  tok = strtok_r(NULL, " \t\r\n", save);
+  v = tok == NULL ? 0 : strtol(tok, &end, 0);
+  if (tok == NULL || *end != '\0')
+  {
+    return fail(path, line, "bad offset");
+  }
+  patch->offset = (s32)v;
+  tok = strtok_r(NULL, " \t\r\n", save);
+  v = tok == NULL ? 0 : strtol(tok, &end, 0);
+  if (tok == NULL || *end != '\0' || v < 1 || v > PATCH_HITS)
+  {
+    return fail(path, line, "count must be 1 to 4");
+  }
+  patch->count = (u8)v;
+
+  patsize = parse_bytes(save, "=", pattern, sizeof(pattern));
+  repsize = patsize < 0 ? -1 : parse_bytes(save, NULL, replace, sizeof(replace));
+  if (patsize < PATCH_MIN_LEN || repsize < 1)
+  {
+    return fail(path, line, "needs a pattern of 4 to 255 bytes, = and a replacement of 1 to 255 bytes");
+  }
+  if (g_pack.data_size + patsize + repsize > MAX_DATA)
+  {
+    return fail(path, line, "too many pattern bytes");
+  }
+  patch->patsize = patsize;
+  patch->pattern = g_pack.data_size;
+  memcpy(g_pack.data + g_pack.data_size, pattern, patsize);
+  g_pack.data_size += patsize;
+  patch->repsize = repsize;
+  patch->replace = g_pack.data_size;
+  memcpy(g_pack.data + g_pack.data_size, replace, repsize);
+  g_pack.data_size += repsize;
+
+  set->count++;
+  g_pack.npatches++;
+  return 0;
+}
+
+static int parse_titles(char **save, const char *path, int line)
+{
+  patchfile_title *title;
+  char *tok;
+  char *end;
+  int n;
+
+  if (g_pack.nsets > 0 && g_pack.sets[g_pack.nsets - 1].count == 0)
+  {
+    return fail(path, line, "the set before has no patches");
+  }
+  if (g_pack.nsets == MAX_SETS)
+  {
+    return fail(path, line, "too many sets");
+  }
+  g_pack.sets[g_pack.nsets].first = g_pack.npatches;
+  g_pack.sets[g_pack.nsets].count = 0;
+  n = 0;
+  while ((tok = strtok_r(NULL, " \t\r\n", save)) != NULL)
+  {
+    if (g_pack.ntitles == MAX_TITLES)
+    {
+      return fail(path, line, "too many titles");
+    }
+    title = &g_pack.titles[g_pack.ntitles++];
+    title->progid = strtoull(tok, &end, 16);
+    title->set = g_pack.nsets;
+    title->reserved = 0;
+    if (*end != '\0')
+    {
+      return fail(path, line, "bad program ID");
+    }
+    n++;
+  }
+  if (n == 0)
+  {
+    return fail(path, line, "titles needs a program ID");
+  }
+  g_pack.nsets++;
+  return 0;
+}
+
+static int parse_file(const char *path)
+{
+  FILE *fp;
+  char buf[LINE_MAX];
+  char *save;
+  char *tok;
+  char *hash;
+  int line;
+  int res;
+
+  fp = fopen(path, "r");
+  if (fp == NULL)
+  {
+    fprintf(stderr, "%s: cannot read\n", path);
+    return -1;
+  }
+  res = 0;
+  for (line = 1; res == 0 && fgets(buf, sizeof(buf), fp) != NULL; line++)
+  {
+    hash = strchr(buf, '#');
+    if (hash != NULL)
+    {
+      *hash = '\0';
+    }
+    tok = strtok_r(buf, " \t\r\n", &save);
+    if (tok == NULL)
+    {
+      continue;
+    }
+    if (strcmp(tok, "titles") == 0)
+    {
+      res = parse_titles(&save, path, line);
+    }
+    else if (strcmp(tok, "patch") == 0)
+    {
+      res = parse_patch(&save, path, line);
+    }
+    else
+    {
+      res = fail(path, line, "expected titles or patch");
+    }
+  }
+  fclose(fp);
+  if (res == 0 && g_pack.nsets > 0 && g_pack.sets[g_pack.nsets - 1].count == 0)
+  {
+    res = fail(path, line, "the last set has no patches");
+  }
+  return res;
+}
+
+static int compare_titles(const void *a, const void *b)
+{
+  const patchfile_title *x = a;
+  const patchfile_title *y = b;
+
+  return x->progid < y->progid ? -1 : x->progid > y->progid;
+}
+
+int main(int argc, char *argv[])
+{
+  patchfile_header header;
+  FILE *fp;
+  u32 size;
+  u32 i;
+
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: %s patches.txt patches.bin\n", argv[0]);
+    return 1;
+  }
+  if (parse_file(argv[1]) < 0)
+  {
+    return 1;
+  }
+  qsort(g_pack.titles, g_pack.ntitles, sizeof(g_pack.titles[0]), compare_titles);
+  for (i = 1; i < g_pack.ntitles; i++)
+  {
+    if (g_pack.titles[i].progid == g_pack.titles[i - 1].progid)
+    {
+      fprintf(stderr, "%s: %016llX is in more than one set\n", argv[1], (unsigned long long)g_pack.titles[i].progid);
+      return 1;
+    }
+  }
+
+  header.magic = PATCHFILE_MAGIC;
+  header.version = PATCHFILE_VERSION;
+  header.titles = g_pack.ntitles;
+  header.sets = g_pack.nsets;
+  header.patches = g_pack.npatches;
+  header.data_size = g_pack.data_size;
+  size = sizeof(header) + g_pack.ntitles * sizeof(patchfile_title) + g_pack.nsets * sizeof(patchfile_set) +
+    g_pack.npatches * sizeof(patchfile_patch) + g_pack.data_size;
+
+  fp = fopen(argv[2], "wb");
+  if (fp == NULL ||
+      fwrite(&header, sizeof(header), 1, fp) != 1 ||
+      fwrite(g_pack.titles, sizeof(patchfile_title), g_pack.ntitles, fp) != g_pack.ntitles ||
+      fwrite(g_pack.sets, sizeof(patchfile_set), g_pack.nsets, fp) != g_pack.nsets ||
+      fwrite(g_pack.patches, sizeof(patchfile_patch), g_pack.npatches, fp) != g_pack.npatches ||
+      fwrite(g_pack.data, 1, g_pack.data_size, fp) != g_pack.data_size ||
+      fclose(fp) != 0)
+  {
+    fprintf(stderr, "%s: cannot write\n", argv[2]);
+    return 1;
+  }
+  printf("%u titles, %u sets, %u patches, %u bytes\n", g_pack.ntitles, g_pack.nsets, g_pack.npatches, size);
+  if (size > MAX_DATA)
+  {
+    fprintf(stderr, "%s: larger than the loader's default PATCHFILE_ARENA_SIZE of %u bytes\n", argv[2], MAX_DATA);
+  }
+  return 0;
+}
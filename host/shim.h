@@ -0,0 +1,88 @@
+#pragma once
+
+#include <3ds.h>
+
+// Controls for the in-process kernel and service stand-ins. Nothing here
+// exists on the console, only host tools, benchmarks and the shim_*.c files
+// themselves call these.
+
+// kernel objects, every handle refers to one of these
+typedef enum
+{
+  HOST_OBJ_EVENT = 1,
+  HOST_OBJ_THREAD,
+  HOST_OBJ_FILE,
+  HOST_OBJ_MUTEX,
+  HOST_OBJ_PORT,
+  HOST_OBJ_SESSION,        // the server's end
+  HOST_OBJ_CLIENT_SESSION,
+  HOST_OBJ_CODESET,
+  HOST_OBJ_PROCESS,
+} host_object_type;
+
+typedef struct host_object
+{
+  host_object_type type;
+  int signaled;
+  ResetType reset;
+  void (*destroy)(struct host_object *obj);
+} host_object;
+
+void host_lock(void);
+void host_unlock(void);
+Handle host_handle_alloc(host_object *obj);
+void *host_handle_get(Handle handle, host_object_type type);
+// these must be called with the lock held
+host_object *host_handle_lookup(Handle handle);
+void host_object_signal(host_object *obj);
+// takes a signaled object the way a wait does, returns 0 if it is not
+int host_object_acquire(host_object *obj);
+// until any object changes state
+void host_wait(void);
+
+// filesystem: a per-request latency and a bandwidth for file reads and writes
+typedef struct
+{
+  u32 request_usec;
+  u32 bytes_per_usec; // 0 is unlimited
+} host_fs_latency;
+
+void host_fs_set_latency(const host_fs_latency *latency);
+void host_fs_set_root(FS_ArchiveID id, const char *dir);
+Result host_fs_open(const char *path, u32 flags, Handle *out);
+
+// fs:REG: registered programs get consecutive handles, each request costs
+// request_usec plus entry_usec for every exheader it returns
+typedef struct
+{
+  u32 request_usec;
+  u32 entry_usec;
+} host_fsreg_latency;
+
+void host_fsreg_set_latency(const host_fsreg_latency *latency);
+
+// fs:REG and PxiPM serve programs from a directory with one subdirectory per
+// program ID, named in 16 hex digits, holding exheader.bin and code.bin (the
+// ExeFS .code). Without one, or for programs missing there, exheaders are
+// blank apart from the program ID and name.
+void host_fsreg_set_titles(const char *dir);
+// the code.bin of a registered program, returns 0 if there is none
+int host_fsreg_code_path(u64 prog_handle, char *path, u32 size);
+
+// srv: queues a notification for the service that enabled them
+Result host_srv_notify(u32 id);
+
+// processes: what svcCreateProcess was given, the segments stay mapped until
+// the process handle is closed
+#define HOST_PROCESS_CAPS 28
+
+typedef struct
+{
+  CodeSetInfo info;
+  u8 *text;
+  u8 *ro;
+  u8 *data;
+  u32 caps[HOST_PROCESS_CAPS];
+} host_process;
+
+const host_process *host_process_get(Handle process);
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "shim.h"
+#include "fsldr.h"
+
+#define MAX_ROOTS 8
+
+#define RES_NOT_FOUND 0xC8804478
+#define RES_INVALID_HANDLE 0xD8E007F7
+#define RES_IO_ERROR 0xC8804464
+#define RES_NOT_SUPPORTED 0xE0C046F8
+#define RES_NOT_MOUNTED 0xC8804465
+
+typedef struct
+{
+  host_object hdr;
+  int fd;
+} file_obj;
+
+typedef struct
+{
+  FS_ArchiveID id;
+  char dir[256];
+} root_t;
+
+static host_fs_latency g_latency;
+static root_t g_roots[MAX_ROOTS];
+static int g_root_count;
+
+void host_fs_set_latency(const host_fs_latency *latency)
+{
+  g_latency = *latency;
+}
+
+void host_fs_set_root(FS_ArchiveID id, const char *dir)
+{
+  int i;
+
+  for (i = 0; i < g_root_count; i++)
+  {
+    if (g_roots[i].id == id)
+    {
+      break;
+    }
+  }
+  if (i == MAX_ROOTS)
+  {
+    return;
+  }
+  g_roots[i].id = id;
+  snprintf(g_roots[i].dir, sizeof(g_roots[i].dir), "%s", dir);
+  if (i == g_root_count)
+  {
+    g_root_count++;
+  }
+}
+
+static const char *find_root(u32 id)
+{
+  int i;
+
+  for (i = 0; i < g_root_count; i++)
+  {
+    if (g_roots[i].id == id)
+    {
+      return g_roots[i].dir;
+    }
+  }
+  return NULL;
+}
+
+// the device would be busy for this long serving a request of `len` bytes
+static void simulate_request(u32 len)
+{
+  u64 usec;
+
+  usec = g_latency.request_usec;
+  if (g_latency.bytes_per_usec)
+  {
+    usec += len / g_latency.bytes_per_usec;
+  }
+  if (usec)
+  {
+    svcSleepThread((s64)usec * 1000);
+  }
+}
+
+static void file_destroy(host_object *obj)
+{
+  close(((file_obj *)obj)->fd);
+  free(obj);
+}
+
+Result host_fs_open(const char *path, u32 flags, Handle *out)
+{
+  file_obj *file;
+  int mode;
+  int fd;
+
+  mode = (flags & FS_OPEN_WRITE) ? O_RDWR : O_RDONLY;
+  if (flags & FS_OPEN_CREATE)
+  {
+    mode |= O_CREAT;
+  }
+  fd = open(path, mode, 0644);
+  if (fd < 0)
+  {
+    return RES_NOT_FOUND;
+  }
+  file = calloc(1, sizeof(file_obj));
+  file->hdr.type = HOST_OBJ_FILE;
+  file->hdr.destroy = file_destroy;
+  file->fd = fd;
+  *out = host_handle_alloc(&file->hdr);
+  simulate_request(0);
+  return 0;
+}
+
+Result fsldrInit(void)
+{
+  return 0;
+}
+
+void fsldrExit(void)
+{
+}
+
+Result FSLDR_InitializeWithSdkVersion(Handle session, u32 version)
+{
+  return 0;
+}
+
+Result FSLDR_SetPriority(u32 priority)
+{
+  return 0;
+}
+
+Result FSLDR_OpenFileDirectly(Handle* out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes)
+{
+  char full[512];
+  const char *root;
+
+  // a program's .code, from fs:REG's title directory
+  if (archive.id == ARCHIVE_SAVEDATA_AND_CONTENT2)
+  {
+    if (archive.lowPath.type != PATH_BINARY || archive.lowPath.size != 8 ||
+        !host_fsreg_code_path(*(const u64 *)archive.lowPath.data, full, sizeof(full)))
+    {
+      return RES_NOT_FOUND;
+    }
+    return host_fs_open(full, openFlags, out);
+  }
+  // an archive without a directory is one that is not mounted yet
+  root = find_root(archive.id);
+  if (root == NULL)
+  {
+    return RES_NOT_MOUNTED;
+  }
+  if (path.type != PATH_ASCII)
+  {
+    return RES_NOT_SUPPORTED;
+  }
+  snprintf(full, sizeof(full), "%s/%s", root, (const char *)path.data);
+  return host_fs_open(full, openFlags, out);
+}
+
+Result FSFILE_Read(Handle handle, u32* bytesRead, u64 offset, void* buffer, u32 size)
+{
+  file_obj *file;
+  ssize_t len;
+
+  file = host_handle_get(handle, HOST_OBJ_FILE);
+  if (file == NULL)
+  {
+    return RES_INVALID_HANDLE;
+  }
+  len = pread(file->fd, buffer, size, offset);
+  if (len < 0)
+  {
+    return RES_IO_ERROR;
+  }
+  simulate_request(len);
+  *bytesRead = (u32)len;
+  return 0;
+}
+
+Result FSFILE_Write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size, u32 flags)
+{
+  file_obj *file;
+  ssize_t len;
+
+  file = host_handle_get(handle, HOST_OBJ_FILE);
+  if (file == NULL)
+  {
+    return RES_INVALID_HANDLE;
+  }
+  len = pwrite(file->fd, buffer, size, offset);
+  if (len < 0)
+  {
+    return RES_IO_ERROR;
+  }
+  simulate_request(len);
+  *bytesWritten = (u32)len;
+  return 0;
+}
+
+Result FSFILE_GetSize(Handle handle, u64* size)
+{
+  file_obj *file;
+  struct stat st;
+
+  file = host_handle_get(handle, HOST_OBJ_FILE);
+  if (file == NULL || fstat(file->fd, &st) != 0)
+  {
+    return RES_INVALID_HANDLE;
+  }
+  *size = st.st_size;
+  return 0;
+}
+
+Result FSFILE_SetSize(Handle handle, u64 size)
+{
+  file_obj *file;
+
+  file = host_handle_get(handle, HOST_OBJ_FILE);
+  if (file == NULL)
+  {
+    return RES_INVALID_HANDLE;
+  }
+  return ftruncate(file->fd, size) == 0 ? 0 : RES_IO_ERROR;
+}
+
+Result FSFILE_Close(Handle handle)
+{
+  return svcCloseHandle(handle);
+}
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <string.h>
+#include "shim.h"
+#include "fsreg.h"
+#include "pxipm.h"
+
+// Stand-in for fs:REG, and for PxiPM which serves the same programs. They
+// live in a table for as long as they are registered, their exheaders come
+// from the title directory if there is one.
+
+#define MAX_PROGRAMS 256
+#define FIRST_HANDLE 0x0000000100000001ULL
+
+#define RES_NOT_FOUND 0xC8804478
+#define RES_OUT_OF_RESOURCE 0xC8804467
+
+typedef struct
+{
+  u64 prog_handle; // 0 if the slot is free
+  u64 progid;
+} program_t;
+
+static host_fsreg_latency g_latency;
+static program_t g_programs[MAX_PROGRAMS];
+static u64 g_next_handle = FIRST_HANDLE;
+static char g_titles[256];
+
+void host_fsreg_set_latency(const host_fsreg_latency *latency)
+{
+  g_latency = *latency;
+}
+
+static void simulate_request(u32 entries)
+{
+  u64 usec;
+
+  usec = g_latency.request_usec + (u64)g_latency.entry_usec * entries;
+  if (usec)
+  {
+    svcSleepThread((s64)usec * 1000);
+  }
+}
+
+void host_fsreg_set_titles(const char *dir)
+{
+  snprintf(g_titles, sizeof(g_titles), "%s", dir);
+}
+
+static int title_path(u64 progid, const char *name, char *path, u32 size)
+{
+  if (g_titles[0] == '\0')
+  {
+    return 0;
+  }
+  snprintf(path, size, "%s/%016llX/%s", g_titles, (unsigned long long)progid, name);
+  return 1;
+}
+
+// must be called with the lock held
+static program_t *find_program(u64 prog_handle)
+{
+  int i;
+
+  for (i = 0; i < MAX_PROGRAMS; i++)
+  {
+    if (g_programs[i].prog_handle != 0 && g_programs[i].prog_handle == prog_handle)
+    {
+      return &g_programs[i];
+    }
+  }
+  return NULL;
+}
+
+Result fsregInit(void)
+{
+  return 0;
+}
+
+void fsregExit(void)
+{
+}
+
+Result FSREG_CheckHostLoadId(u64 prog_handle)
+{
+  simulate_request(0);
+  return 0;
+}
+
+Result FSREG_LoadProgram(u64 *prog_handle, FS_ProgramInfo *title)
+{
+  Result res;
+  int i;
+
+  simulate_request(0);
+  res = RES_OUT_OF_RESOURCE;
+  host_lock();
+  for (i = 0; i < MAX_PROGRAMS; i++)
+  {
+    if (g_programs[i].prog_handle == 0)
+    {
+      g_programs[i].prog_handle = g_next_handle++;
+      g_programs[i].progid = title->programId;
+      *prog_handle = g_programs[i].prog_handle;
+      res = 0;
+      break;
+    }
+  }
+  host_unlock();
+  return res;
+}
+
+int host_fsreg_code_path(u64 prog_handle, char *path, u32 size)
+{
+  program_t *program;
+  u64 progid;
+
+  host_lock();
+  program = find_program(prog_handle);
+  progid = program != NULL ? program->progid : 0;
+  host_unlock();
+  return program != NULL && title_path(progid, "code.bin", path, size);
+}
+
+static void read_exheader(exheader_header *exheader, u64 progid)
+{
+  char path[512];
+  FILE *fp;
+
+  if (title_path(progid, "exheader.bin", path, sizeof(path)) && (fp = fopen(path, "rb")) != NULL)
+  {
+    // the access descriptor after it is not needed
+    if (fread(exheader, sizeof(exheader_header), 1, fp) == 1)
+    {
+      fclose(fp);
+      return;
+    }
+    fclose(fp);
+  }
+  memset(exheader, 0, sizeof(exheader_header));
+  memcpy(exheader->codesetinfo.name, &progid, 8);
+  exheader->arm11systemlocalcaps.programid = progid;
+}
+
+Result FSREG_GetProgramInfo(exheader_header *exheader, u32 entry_count, u64 prog_handle)
+{
+  program_t *program;
+  u64 progid;
+  u32 i;
+
+  simulate_request(entry_count);
+  for (i = 0; i < entry_count; i++)
+  {
+    host_lock();
+    program = find_program(prog_handle + i);
+    progid = program != NULL ? program->progid : 0;
+    host_unlock();
+    if (program == NULL)
+    {
+      return RES_NOT_FOUND;
+    }
+    read_exheader(&exheader[i], progid);
+  }
+  return 0;
+}
+
+Result FSREG_UnloadProgram(u64 prog_handle)
+{
+  program_t *program;
+  Result res;
+
+  simulate_request(0);
+  res = RES_NOT_FOUND;
+  host_lock();
+  program = find_program(prog_handle);
+  if (program != NULL)
+  {
+    program->prog_handle = 0;
+    res = 0;
+  }
+  host_unlock();
+  return res;
+}
+
+Result FSREG_Unregister(u32 pid)
+{
+  simulate_request(0);
+  return 0;
+}
+
+Result FSREG_Register(u32 pid, u64 prog_handle, FS_ProgramInfo *info, void *storageinfo)
+{
+  simulate_request(0);
+  return 0;
+}
+
+Result pxipmInit(void)
+{
+  return 0;
+}
+
+void pxipmExit(void)
+{
+}
+
+Result PXIPM_RegisterProgram(u64 *prog_handle, FS_ProgramInfo *title, FS_ProgramInfo *update)
+{
+  return FSREG_LoadProgram(prog_handle, title);
+}
+
+Result PXIPM_GetProgramInfo(exheader_header *exheader, u64 prog_handle)
+{
+  return FSREG_GetProgramInfo(exheader, 1, prog_handle);
+}
+
+Result PXIPM_UnregisterProgram(u64 prog_handle)
+{
+  return FSREG_UnloadProgram(prog_handle);
+}
@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "shim.h"
+#include "srvsys.h"
+
+// Stand-in for ports, sessions and srv:. A service registered through
+// srvSysRegisterService is a port that srvSysGetServiceHandle connects to,
+// and a request goes from the client's command buffer to the server's and
+// back, all in one process. Handles are moved as they are since both ends
+// share one handle table, and static buffers are passed as the pointer the
+// server replies with instead of being copied.
+
+#define MAX_SERVICES 16
+#define MAX_PENDING 8
+#define MAX_NOTIFICATIONS 16
+#define CMDBUF_WORDS 64
+
+#define RES_INVALID_HANDLE 0xD8E007F7
+#define RES_OUT_OF_HANDLES 0xD8600413
+#define RES_SESSION_CLOSED 0xC920181A
+#define RES_NOT_FOUND 0xD8801BFA
+#define RES_ALREADY_EXISTS 0xD9001BFC
+#define RES_PORT_FULL 0xD0401834
+
+enum
+{
+  SESSION_IDLE,
+  SESSION_REQUEST,  // the client waits, the server has not received it
+  SESSION_RECEIVED, // the server has it and owes a reply
+  SESSION_REPLIED,
+};
+
+typedef struct
+{
+  host_object server;
+  host_object client;
+  int server_open;
+  int client_open;
+  int state;
+  u32 *cmdbuf; // the client's, while it waits
+} session_t;
+
+typedef struct
+{
+  host_object hdr; // signaled while sessions wait to be accepted
+  char name[9]; // srv: names are up to 8 characters
+  session_t *pending[MAX_PENDING];
+  int count;
+} port_obj;
+
+static port_obj *g_services[MAX_SERVICES];
+static Handle g_notification;
+static u32 g_notifications[MAX_NOTIFICATIONS];
+static int g_notification_count;
+static __thread u32 t_cmdbuf[CMDBUF_WORDS];
+
+u32* getThreadCommandBuffer(void)
+{
+  return t_cmdbuf;
+}
+
+// the words a header says follow it
+static u32 message_words(u32 header)
+{
+  u32 words;
+
+  words = 1 + ((header >> 6) & 0x3F) + (header & 0x3F);
+  return words > CMDBUF_WORDS ? CMDBUF_WORDS : words;
+}
+
+// sessions
+
+static session_t *server_session(host_object *obj)
+{
+  return (session_t *)((u8 *)obj - offsetof(session_t, server));
+}
+
+static session_t *client_session(host_object *obj)
+{
+  return (session_t *)((u8 *)obj - offsetof(session_t, client));
+}
+
+// a session is freed once both of its ends are closed
+static void session_close(session_t *session, int *end)
+{
+  int unused;
+
+  host_lock();
+  *end = 0;
+  unused = !session->server_open && !session->client_open;
+  // wakes a client waiting for a reply and a server waiting for requests
+  host_object_signal(&session->server);
+  host_unlock();
+  if (unused)
+  {
+    free(session);
+  }
+}
+
+static void server_destroy(host_object *obj)
+{
+  session_t *session;
+
+  session = server_session(obj);
+  session_close(session, &session->server_open);
+}
+
+static void client_destroy(host_object *obj)
+{
+  session_t *session;
+
+  session = client_session(obj);
+  session_close(session, &session->client_open);
+}
+
+Result svcSendSyncRequest(Handle handle)
+{
+  host_object *obj;
+  session_t *session;
+  Result res;
+
+  host_lock();
+  obj = host_handle_lookup(handle);
+  if (obj == NULL || obj->type != HOST_OBJ_CLIENT_SESSION)
+  {
+    host_unlock();
+    return RES_INVALID_HANDLE;
+  }
+  session = client_session(obj);
+  if (!session->server_open)
+  {
+    host_unlock();
+    return RES_SESSION_CLOSED;
+  }
+  session->cmdbuf = t_cmdbuf;
+  session->state = SESSION_REQUEST;
+  host_object_signal(&session->server);
+  while (session->state != SESSION_REPLIED && session->server_open)
+  {
+    host_wait();
+  }
+  res = session->state == SESSION_REPLIED ? 0 : RES_SESSION_CLOSED;
+  session->state = SESSION_IDLE;
+  session->cmdbuf = NULL;
+  host_unlock();
+  return res;
+}
+
+Result svcAcceptSession(Handle* out, Handle port)
+{
+  port_obj *obj;
+  session_t *session;
+
+  host_lock();
+  obj = (port_obj *)host_handle_lookup(port);
+  if (obj == NULL || obj->hdr.type != HOST_OBJ_PORT)
+  {
+    host_unlock();
+    return RES_INVALID_HANDLE;
+  }
+  if (obj->count == 0)
+  {
+    host_unlock();
+    return RES_NOT_FOUND;
+  }
+  session = obj->pending[0];
+  obj->count--;
+  memmove(&obj->pending[0], &obj->pending[1], obj->count * sizeof(obj->pending[0]));
+  obj->hdr.signaled = obj->count > 0;
+  host_unlock();
+
+  *out = host_handle_alloc(&session->server);
+  if (*out == 0)
+  {
+    server_destroy(&session->server);
+    return RES_OUT_OF_HANDLES;
+  }
+  return 0;
+}
+
+Result svcReplyAndReceive(s32* index, const Handle* handles, s32 handleCount, Handle replyTarget)
+{
+  host_object *obj;
+  session_t *session;
+  s32 i;
+
+  host_lock();
+  if (replyTarget != 0)
+  {
+    obj = host_handle_lookup(replyTarget);
+    if (obj == NULL || obj->type != HOST_OBJ_SESSION)
+    {
+      host_unlock();
+      return RES_INVALID_HANDLE;
+    }
+    session = server_session(obj);
+    if (!session->client_open || session->state != SESSION_RECEIVED)
+    {
+      *index = -1;
+      host_unlock();
+      return RES_SESSION_CLOSED;
+    }
+    memcpy(session->cmdbuf, t_cmdbuf, message_words(t_cmdbuf[0]) * 4);
+    session->state = SESSION_REPLIED;
+    host_object_signal(&session->client);
+  }
+
+  while (handleCount > 0)
+  {
+    for (i = 0; i < handleCount; i++)
+    {
+      obj = host_handle_lookup(handles[i]);
+      if (obj == NULL)
+      {
+        host_unlock();
+        return RES_INVALID_HANDLE;
+      }
+      if (obj->type != HOST_OBJ_SESSION)
+      {
+        if (host_object_acquire(obj))
+        {
+          break;
+        }
+        continue;
+      }
+      session = server_session(obj);
+      if (!session->client_open)
+      {
+        *index = i;
+        host_unlock();
+        return RES_SESSION_CLOSED;
+      }
+      if (session->state == SESSION_REQUEST)
+      {
+        memcpy(t_cmdbuf, session->cmdbuf, message_words(session->cmdbuf[0]) * 4);
+        session->state = SESSION_RECEIVED;
+        break;
+      }
+    }
+    if (i < handleCount)
+    {
+      *index = i;
+      break;
+    }
+    host_wait();
+  }
+  host_unlock();
+  return 0;
+}
+
+// srv:
+
+static void port_destroy(host_object *obj)
+{
+  port_obj *port;
+  session_t *session;
+  int i;
+
+  port = (port_obj *)obj;
+  host_lock();
+  for (i = 0; i < MAX_SERVICES; i++)
+  {
+    if (g_services[i] == port)
+    {
+      g_services[i] = NULL;
+    }
+  }
+  host_unlock();
+  // sessions nobody accepted are closed on the server's side
+  for (i = 0; i < port->count; i++)
+  {
+    session = port->pending[i];
+    session_close(session, &session->server_open);
+  }
+  free(port);
+}
+
+// must be called with the lock held
+static int find_service(const char *name)
+{
+  int i;
+
+  for (i = 0; i < MAX_SERVICES; i++)
+  {
+    if (g_services[i] != NULL && strncmp(g_services[i]->name, name, sizeof(g_services[i]->name) - 1) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+Result srvSysInit(void)
+{
+  return 0;
+}
+
+Result srvSysExit(void)
+{
+  return 0;
+}
+
+Result srvSysRegisterClient(void)
+{
+  return 0;
+}
+
+Result srvSysRegisterService(Handle* out, const char* name, int maxSessions)
+{
+  port_obj *port;
+  int i;
+
+  port = calloc(1, sizeof(port_obj));
+  port->hdr.type = HOST_OBJ_PORT;
+  port->hdr.destroy = port_destroy;
+  snprintf(port->name, sizeof(port->name), "%s", name);
+  *out = host_handle_alloc(&port->hdr);
+  if (*out == 0)
+  {
+    free(port);
+    return RES_OUT_OF_HANDLES;
+  }
+  host_lock();
+  if (find_service(name) >= 0)
+  {
+    host_unlock();
+    svcCloseHandle(*out);
+    return RES_ALREADY_EXISTS;
+  }
+  for (i = 0; i < MAX_SERVICES && g_services[i] != NULL; i++);
+  if (i == MAX_SERVICES)
+  {
+    host_unlock();
+    svcCloseHandle(*out);
+    return RES_OUT_OF_HANDLES;
+  }
+  g_services[i] = port;
+  host_unlock();
+  return 0;
+}
+
+Result srvSysUnregisterService(const char* name)
+{
+  int i;
+
+  host_lock();
+  i = find_service(name);
+  if (i >= 0)
+  {
+    g_services[i] = NULL;
+  }
+  host_unlock();
+  return i >= 0 ? 0 : RES_NOT_FOUND;
+}
+
+Result srvSysGetServiceHandle(Handle* out, const char* name)
+{
+  session_t *session;
+  port_obj *port;
+  int i;
+
+  session = calloc(1, sizeof(session_t));
+  session->server.type = HOST_OBJ_SESSION;
+  session->server.destroy = server_destroy;
+  session->client.type = HOST_OBJ_CLIENT_SESSION;
+  session->client.destroy = client_destroy;
+  session->client_open = 1;
+  *out = host_handle_alloc(&session->client);
+  if (*out == 0)
+  {
+    free(session);
+    return RES_OUT_OF_HANDLES;
+  }
+  host_lock();
+  i = find_service(name);
+  port = i >= 0 ? g_services[i] : NULL;
+  if (port == NULL || port->count == MAX_PENDING)
+  {
+    host_unlock();
+    svcCloseHandle(*out);
+    return port == NULL ? RES_NOT_FOUND : RES_PORT_FULL;
+  }
+  session->server_open = 1;
+  port->pending[port->count++] = session;
+  host_object_signal(&port->hdr);
+  host_unlock();
+  return 0;
+}
+
+Result srvSysEnableNotification(Handle* semaphoreOut)
+{
+  Result res;
+
+  res = svcCreateEvent(&g_notification, RESET_ONESHOT);
+  *semaphoreOut = g_notification;
+  return res;
+}
+
+Result srvSysReceiveNotification(u32* notificationIdOut)
+{
+  host_object *obj;
+
+  host_lock();
+  *notificationIdOut = 0;
+  if (g_notification_count > 0)
+  {
+    *notificationIdOut = g_notifications[0];
+    g_notification_count--;
+    memmove(&g_notifications[0], &g_notifications[1], g_notification_count * sizeof(g_notifications[0]));
+  }
+  obj = host_handle_lookup(g_notification);
+  if (obj != NULL && g_notification_count > 0)
+  {
+    host_object_signal(obj);
+  }
+  host_unlock();
+  return 0;
+}
+
+Result host_srv_notify(u32 id)
+{
+  host_object *obj;
+  Result res;
+
+  host_lock();
+  obj = host_handle_lookup(g_notification);
+  res = RES_NOT_FOUND;
+  if (obj != NULL && obj->type == HOST_OBJ_EVENT && g_notification_count < MAX_NOTIFICATIONS)
+  {
+    g_notifications[g_notification_count++] = id;
+    host_object_signal(obj);
+    res = 0;
+  }
+  host_unlock();
+  return res;
+}
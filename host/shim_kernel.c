@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "shim.h"
+
+#define MAX_HANDLES 1024
+#define HANDLE_BASE 0x1000
+#define DEFAULT_PRIORITY 0x30
+
+#define RES_INVALID_HANDLE 0xD8E007F7
+#define RES_OUT_OF_HANDLES 0xD8600413
+#define RES_TIMEOUT 0x09401BFE
+
+typedef struct
+{
+  host_object hdr;
+  pthread_t owner;
+  u32 count; // 0 if unowned, recursive like the kernel's
+} mutex_obj;
+
+typedef struct
+{
+  host_object hdr;
+  ThreadFunc entry;
+  u32 arg;
+  s32 prio;
+  pthread_t tid;
+} thread_obj;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static host_object *g_objects[MAX_HANDLES];
+static __thread thread_obj *t_current;
+
+static void init_once(void)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&g_cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+void host_lock(void)
+{
+  pthread_once(&g_once, init_once);
+  pthread_mutex_lock(&g_lock);
+}
+
+void host_unlock(void)
+{
+  pthread_mutex_unlock(&g_lock);
+}
+
+Handle host_handle_alloc(host_object *obj)
+{
+  int i;
+
+  host_lock();
+  for (i = 0; i < MAX_HANDLES; i++)
+  {
+    if (g_objects[i] == NULL)
+    {
+      g_objects[i] = obj;
+      host_unlock();
+      return HANDLE_BASE + i;
+    }
+  }
+  host_unlock();
+  return 0;
+}
+
+host_object *host_handle_lookup(Handle handle)
+{
+  if (handle < HANDLE_BASE || handle >= HANDLE_BASE + MAX_HANDLES)
+  {
+    return NULL;
+  }
+  return g_objects[handle - HANDLE_BASE];
+}
+
+void *host_handle_get(Handle handle, host_object_type type)
+{
+  host_object *obj;
+
+  host_lock();
+  obj = host_handle_lookup(handle);
+  host_unlock();
+  if (obj == NULL || obj->type != type)
+  {
+    return NULL;
+  }
+  return obj;
+}
+
+void host_object_signal(host_object *obj)
+{
+  obj->signaled = 1;
+  pthread_cond_broadcast(&g_cond);
+}
+
+Result svcCloseHandle(Handle handle)
+{
+  host_object *obj;
+
+  host_lock();
+  obj = host_handle_lookup(handle);
+  if (obj == NULL)
+  {
+    host_unlock();
+    return RES_INVALID_HANDLE;
+  }
+  g_objects[handle - HANDLE_BASE] = NULL;
+  host_unlock();
+  if (obj->destroy)
+  {
+    obj->destroy(obj);
+  }
+  else
+  {
+    free(obj);
+  }
+  return 0;
+}
+
+// events
+
+Result svcCreateEvent(Handle* event, ResetType reset_type)
+{
+  host_object *obj;
+
+  obj = calloc(1, sizeof(host_object));
+  obj->type = HOST_OBJ_EVENT;
+  obj->reset = reset_type;
+  *event = host_handle_alloc(obj);
+  if (*event == 0)
+  {
+    free(obj);
+    return RES_OUT_OF_HANDLES;
+  }
+  return 0;
+}
+
+static Result set_event(Handle handle, int state)
+{
+  host_object *obj;
+
+  host_lock();
+  obj = host_handle_lookup(handle);
+  if (obj == NULL || obj->type != HOST_OBJ_EVENT)
+  {
+    host_unlock();
+    return RES_INVALID_HANDLE;
+  }
+  if (state)
+  {
+    host_object_signal(obj);
+  }
+  else
+  {
+    obj->signaled = 0;
+  }
+  host_unlock();
+  return 0;
+}
+
+Result svcSignalEvent(Handle handle)
+{
+  return set_event(handle, 1);
+}
+
+Result svcClearEvent(Handle handle)
+{
+  return set_event(handle, 0);
+}
+
+// mutexes
+
+Result svcCreateMutex(Handle* mutex, bool initially_locked)
+{
+  mutex_obj *obj;
+
+  obj = calloc(1, sizeof(mutex_obj));
+  obj->hdr.type = HOST_OBJ_MUTEX;
+  if (initially_locked)
+  {
+    obj->owner = pthread_self();
+    obj->count = 1;
+  }
+  *mutex = host_handle_alloc(&obj->hdr);
+  if (*mutex == 0)
+  {
+    free(obj);
+    return RES_OUT_OF_HANDLES;
+  }
+  return 0;
+}
+
+Result svcReleaseMutex(Handle handle)
+{
+  mutex_obj *obj;
+
+  host_lock();
+  obj = (mutex_obj *)host_handle_lookup(handle);
+  if (obj == NULL || obj->hdr.type != HOST_OBJ_MUTEX || obj->count == 0 ||
+      !pthread_equal(obj->owner, pthread_self()))
+  {
+    host_unlock();
+    return RES_INVALID_HANDLE;
+  }
+  if (--obj->count == 0)
+  {
+    pthread_cond_broadcast(&g_cond);
+  }
+  host_unlock();
+  return 0;
+}
+
+// must be called with the lock held, takes the mutex if it is free
+static int mutex_acquire(mutex_obj *obj)
+{
+  if (obj->count != 0 && !pthread_equal(obj->owner, pthread_self()))
+  {
+    return 0;
+  }
+  obj->owner = pthread_self();
+  obj->count++;
+  return 1;
+}
+
+// waiting
+
+int host_object_acquire(host_object *obj)
+{
+  if (obj->type == HOST_OBJ_MUTEX)
+  {
+    return mutex_acquire((mutex_obj *)obj);
+  }
+  if (!obj->signaled)
+  {
+    return 0;
+  }
+  if (obj->type == HOST_OBJ_EVENT && obj->reset != RESET_STICKY)
+  {
+    obj->signaled = 0;
+  }
+  return 1;
+}
+
+void host_wait(void)
+{
+  pthread_cond_wait(&g_cond, &g_lock);
+}
+
+static void deadline_after(struct timespec *ts, s64 ns)
+{
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts->tv_sec += ns / 1000000000LL;
+  ts->tv_nsec += ns % 1000000000LL;
+  if (ts->tv_nsec >= 1000000000L)
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds)
+{
+  host_object *obj;
+  struct timespec deadline;
+  int err;
+
+  if (nanoseconds >= 0 && nanoseconds != (s64)U64_MAX)
+  {
+    deadline_after(&deadline, nanoseconds);
+  }
+  host_lock();
+  while (1)
+  {
+    obj = host_handle_lookup(handle);
+    if (obj == NULL)
+    {
+      host_unlock();
+      return RES_INVALID_HANDLE;
+    }
+    if (host_object_acquire(obj))
+    {
+      host_unlock();
+      return 0;
+    }
+    if (nanoseconds >= 0 && nanoseconds != (s64)U64_MAX)
+    {
+      err = pthread_cond_timedwait(&g_cond, &g_lock, &deadline);
+      if (err == ETIMEDOUT)
+      {
+        host_unlock();
+        return RES_TIMEOUT;
+      }
+    }
+    else
+    {
+      pthread_cond_wait(&g_cond, &g_lock);
+    }
+  }
+}
+
+// threads
+
+static void thread_finish(thread_obj *thread)
+{
+  host_lock();
+  host_object_signal(&thread->hdr);
+  host_unlock();
+}
+
+static void *thread_main(void *arg)
+{
+  thread_obj *thread;
+
+  thread = (thread_obj *)arg;
+  t_current = thread;
+  thread->entry((void *)(uintptr_t)thread->arg);
+  thread_finish(thread);
+  return NULL;
+}
+
+Result svcCreateThread(Handle* thread, ThreadFunc entrypoint, u32 arg, u32* stack_top, s32 thread_priority, s32 processor_id)
+{
+  thread_obj *obj;
+
+  obj = calloc(1, sizeof(thread_obj));
+  obj->hdr.type = HOST_OBJ_THREAD;
+  obj->entry = entrypoint;
+  obj->arg = arg;
+  obj->prio = thread_priority;
+  *thread = host_handle_alloc(&obj->hdr);
+  if (*thread == 0)
+  {
+    free(obj);
+    return RES_OUT_OF_HANDLES;
+  }
+  if (pthread_create(&obj->tid, NULL, thread_main, obj) != 0)
+  {
+    svcCloseHandle(*thread);
+    return RES_OUT_OF_HANDLES;
+  }
+  pthread_detach(obj->tid);
+  return 0;
+}
+
+void svcExitThread(void)
+{
+  if (t_current)
+  {
+    thread_finish(t_current);
+  }
+  pthread_exit(NULL);
+}
+
+Result svcGetThreadPriority(s32 *out, Handle handle)
+{
+  thread_obj *thread;
+
+  if (handle == CUR_THREAD_HANDLE)
+  {
+    *out = t_current ? t_current->prio : DEFAULT_PRIORITY;
+    return 0;
+  }
+  thread = host_handle_get(handle, HOST_OBJ_THREAD);
+  if (thread == NULL)
+  {
+    return RES_INVALID_HANDLE;
+  }
+  *out = thread->prio;
+  return 0;
+}
+
+void svcSleepThread(s64 ns)
+{
+  struct timespec ts;
+
+  if (ns <= 0)
+  {
+    sched_yield();
+    return;
+  }
+  ts.tv_sec = ns / 1000000000LL;
+  ts.tv_nsec = ns % 1000000000LL;
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+u64 svcGetSystemTick(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((u64)ts.tv_sec * SYSCLOCK_ARM11) + ((u64)ts.tv_nsec * SYSCLOCK_ARM11) / 1000000000ULL;
+}
+
+void svcBreak(UserBreakType breakReason)
+{
+  fprintf(stderr, "svcBreak(%d)\n", breakReason);
+  abort();
+}
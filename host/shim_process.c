@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "shim.h"
+
+// Stand-in for process memory, code sets and processes. Memory is mapped at
+// the address the loader asks for, so the pointers it keeps as u32 work. A
+// code set takes its pages away from the loader the way the kernel's does,
+// by moving the mapping, and the process it is made into keeps them until
+// its handle is closed.
+
+#define PAGE_SIZE 0x1000
+
+#define RES_INVALID_HANDLE 0xD8E007F7
+#define RES_OUT_OF_HANDLES 0xD8600413
+#define RES_INVALID_ADDRESS 0xE0E01BF5
+#define RES_OUT_OF_MEMORY 0xD86007F3
+#define RES_NOT_IMPLEMENTED 0xF8C007F4
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+typedef struct
+{
+  host_object hdr;
+  host_process process;
+  u32 size; // of the mapping at process.text
+} process_obj;
+
+// code sets and processes are the same object, a process is made from a
+// code set by copying it
+static void process_destroy(host_object *obj)
+{
+  process_obj *process;
+
+  process = (process_obj *)obj;
+  if (process->size != 0)
+  {
+    munmap(process->process.text, process->size);
+  }
+  free(process);
+}
+
+Result svcControlMemory(u32* addr_out, u32 addr0, u32 addr1, u32 size, MemOp op, MemPerm perm)
+{
+  void *addr;
+  int flags;
+
+  switch (op & MEMOP_OP_MASK)
+  {
+    case MEMOP_ALLOC:
+    {
+      flags = MAP_PRIVATE | MAP_ANONYMOUS;
+      flags |= addr0 != 0 ? MAP_FIXED_NOREPLACE : MAP_32BIT;
+      addr = mmap((void *)(uintptr_t)addr0, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if (addr == MAP_FAILED || (addr0 != 0 && addr != (void *)(uintptr_t)addr0))
+      {
+        if (addr != MAP_FAILED)
+        {
+          munmap(addr, size);
+        }
+        return addr0 != 0 ? RES_INVALID_ADDRESS : RES_OUT_OF_MEMORY;
+      }
+      *addr_out = (u32)(uintptr_t)addr;
+      return 0;
+    }
+    case MEMOP_FREE:
+    {
+      return munmap((void *)(uintptr_t)addr0, size) == 0 ? 0 : RES_INVALID_ADDRESS;
+    }
+    default:
+    {
+      return RES_NOT_IMPLEMENTED;
+    }
+  }
+}
+
+Result svcCreateCodeSet(Handle* out, const CodeSetInfo *info, void* code_ptr, void* ro_ptr, void* data_ptr)
+{
+  process_obj *codeset;
+  void *dest;
+  u32 size;
+
+  size = (info->text_size + info->ro_size + info->rw_size) * PAGE_SIZE;
+  if ((u8 *)ro_ptr != (u8 *)code_ptr + info->text_size * PAGE_SIZE ||
+      (u8 *)data_ptr != (u8 *)ro_ptr + info->ro_size * PAGE_SIZE)
+  {
+    return RES_INVALID_ADDRESS;
+  }
+  codeset = calloc(1, sizeof(process_obj));
+  codeset->hdr.type = HOST_OBJ_CODESET;
+  codeset->hdr.destroy = process_destroy;
+  codeset->process.info = *info;
+  if (size != 0)
+  {
+    dest = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (dest == MAP_FAILED ||
+        mremap(code_ptr, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, dest) == MAP_FAILED)
+    {
+      if (dest != MAP_FAILED)
+      {
+        munmap(dest, size);
+      }
+      free(codeset);
+      return RES_INVALID_ADDRESS;
+    }
+    codeset->size = size;
+    codeset->process.text = dest;
+    codeset->process.ro = codeset->process.text + info->text_size * PAGE_SIZE;
+    codeset->process.data = codeset->process.ro + info->ro_size * PAGE_SIZE;
+  }
+  *out = host_handle_alloc(&codeset->hdr);
+  if (*out == 0)
+  {
+    process_destroy(&codeset->hdr);
+    return RES_OUT_OF_HANDLES;
+  }
+  return 0;
+}
+
+Result svcCreateProcess(Handle* out, Handle codeset, const u32 *arm11kernelcaps, u32 arm11kernelcaps_num)
+{
+  process_obj *from;
+  process_obj *process;
+
+  host_lock();
+  from = (process_obj *)host_handle_lookup(codeset);
+  if (from == NULL || from->hdr.type != HOST_OBJ_CODESET)
+  {
+    host_unlock();
+    return RES_INVALID_HANDLE;
+  }
+  process = calloc(1, sizeof(process_obj));
+  *process = *from;
+  process->hdr.type = HOST_OBJ_PROCESS;
+  if (arm11kernelcaps_num > HOST_PROCESS_CAPS)
+  {
+    arm11kernelcaps_num = HOST_PROCESS_CAPS;
+  }
+  memcpy(process->process.caps, arm11kernelcaps, arm11kernelcaps_num * sizeof(u32));
+  // the pages go with the process
+  from->size = 0;
+  host_unlock();
+
+  *out = host_handle_alloc(&process->hdr);
+  if (*out == 0)
+  {
+    process_destroy(&process->hdr);
+    return RES_OUT_OF_HANDLES;
+  }
+  return 0;
+}
+
+const host_process *host_process_get(Handle process)
+{
+  process_obj *obj;
+
+  obj = host_handle_get(process, HOST_OBJ_PROCESS);
+  return obj != NULL ? &obj->process : NULL;
+}
+
+void svcExitProcess(void)
+{
+  exit(0);
+}
+
+// the ctrulib startup hooks loader.c declares, there is nothing to set up
+void __sync_init(void)
+{
+}
+
+void __sync_fini(void)
+{
+}
+
+void __system_initSyscalls(void)
+{
+}
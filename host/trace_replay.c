@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "shim.h"
+#include "trace.h"
+#include "commands.h"
+#include "loader_run.h"
+
+// Plays a /loader/trace.bin recorded on the console back through the whole
+// loader on the host (see loader_bench.c) and reports the latency of each
+// command next to what the console took. Program handles in the trace are
+// the console's, they are swapped for the ones the stand-in fs:REG gives out
+// when the same RegisterProgram is replayed.
+
+#define DEFAULT_REQUEST_USEC 200
+#define DEFAULT_BYTES_PER_USEC 8
+#define MAX_COMMANDS 16
+#define MAX_HANDLES 256
+
+typedef struct
+{
+  u32 id;
+  u32 count;
+  u32 mismatched; // results that differ from the console's
+  u64 *host;      // nsec per request
+  u32 *device;    // usec per request
+} command_stats;
+
+typedef struct
+{
+  u64 device;
+  u64 host;
+} handle_map;
+
+static command_stats g_commands[MAX_COMMANDS];
+static u32 g_command_count;
+static handle_map g_handles[MAX_HANDLES];
+static u32 g_handle_count;
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-r] [-l usec] [-b MB/s] [-s sd] trace.bin titles\n", prog);
+  fprintf(stderr, "  titles is the title directory of loader_bench, with the programs the trace launches\n");
+  fprintf(stderr, "  -r  keep the time between requests the console saw, otherwise back to back\n");
+  fprintf(stderr, "  -l  stand-in FS latency per read request (default %d)\n", DEFAULT_REQUEST_USEC);
+  fprintf(stderr, "  -b  stand-in FS bandwidth, 0 is unlimited (default %d)\n", DEFAULT_BYTES_PER_USEC);
+  fprintf(stderr, "  -s  directory standing in for SD, for /loader/ files\n");
+}
+
+static command_stats *stats_for(u32 id, u32 records)
+{
+  u32 i;
+
+  for (i = 0; i < g_command_count; i++)
+  {
+    if (g_commands[i].id == id)
+    {
+      return &g_commands[i];
+    }
+  }
+  if (g_command_count == MAX_COMMANDS)
+  {
+    return NULL;
+  }
+  g_commands[i].id = id;
+  g_commands[i].host = malloc(records * sizeof(u64));
+  g_commands[i].device = malloc(records * sizeof(u32));
+  g_command_count++;
+  return &g_commands[i];
+}
+
+static u64 *host_handle(u64 device)
+{
+  u32 i;
+
+  for (i = 0; i < g_handle_count; i++)
+  {
+    if (g_handles[i].device == device)
+    {
+      return &g_handles[i].host;
+    }
+  }
+  return NULL;
+}
+
+static void map_handle(u64 device, u64 host)
+{
+  u64 *mapped;
+
+  mapped = host_handle(device);
+  if (mapped == NULL && g_handle_count < MAX_HANDLES)
+  {
+    g_handles[g_handle_count].device = device;
+    mapped = &g_handles[g_handle_count++].host;
+  }
+  if (mapped != NULL)
+  {
+    *mapped = host;
+  }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  u64 x = *(const u64 *)a;
+  u64 y = *(const u64 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+  u32 x = *(const u32 *)a;
+  u32 y = *(const u32 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+// replays one request, returns its latency in nsec
+static u64 replay(Handle loader, const trace_record *record, const u32 *request, u32 words, int *mismatched)
+{
+  u32 *cmdbuf;
+  u64 *mapped;
+  u64 device;
+  u64 host;
+  u32 id;
+  u64 t0;
+  u64 t;
+
+  cmdbuf = getThreadCommandBuffer();
+  memcpy(cmdbuf, request, words * 4);
+  id = request[0] >> 16;
+  // LoadProcess, UnregisterProgram and GetProgramInfo take a program handle
+  if ((id == 1 || id == 3 || id == 4) && words >= 3)
+  {
+    memcpy(&device, &request[1], sizeof(device));
+    mapped = host_handle(device);
+    if (mapped != NULL)
+    {
+      memcpy(&cmdbuf[1], mapped, sizeof(*mapped));
+    }
+  }
+  t0 = bench_nsec();
+  if (R_FAILED(svcSendSyncRequest(loader)))
+  {
+    cmdbuf[1] = ~0;
+  }
+  t = bench_nsec() - t0;
+
+  *mismatched = cmdbuf[1] != record->reply[0];
+  if (id == 2 && R_SUCCEEDED(cmdbuf[1]) && R_SUCCEEDED(record->reply[0]))
+  {
+    memcpy(&device, &record->reply[1], sizeof(device));
+    memcpy(&host, &cmdbuf[2], sizeof(host));
+    map_handle(device, host);
+  }
+  if (id == 1 && R_SUCCEEDED(cmdbuf[1]))
+  {
+    svcCloseHandle(cmdbuf[3]);
+  }
+  return t;
+}
+
+static void print_stats(const command_stats *stats)
+{
+  u64 *host;
+  u32 *device;
+  u32 n;
+
+  n = stats->count;
+  host = stats->host;
+  device = stats->device;
+  qsort(host, n, sizeof(host[0]), compare_u64);
+  qsort(device, n, sizeof(device[0]), compare_u32);
+  printf("%-22s %6u %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %6u\n", command_name(stats->id), n,
+    host[(n - 1) / 2] / 1e6, host[(n - 1) * 9 / 10] / 1e6, host[(n - 1) * 99 / 100] / 1e6, host[n - 1] / 1e6,
+    device[(n - 1) / 2] / 1e3, device[(n - 1) * 99 / 100] / 1e3, device[n - 1] / 1e3, stats->mismatched);
+}
+
+int main(int argc, char *argv[])
+{
+  host_fs_latency latency;
+  trace_file_header header;
+  const trace_record *record;
+  const u32 *request;
+  command_stats *stats;
+  Handle thread;
+  Handle loader;
+  u8 *trace;
+  u32 size;
+  u32 offset;
+  u32 words;
+  u32 n;
+  u64 device_span;
+  u64 device_busy;
+  u64 host_busy;
+  u64 begin;
+  u64 due;
+  u64 t;
+  int realtime;
+  int mismatched;
+  int failed;
+  int i;
+
+  realtime = 0;
+  latency.request_usec = DEFAULT_REQUEST_USEC;
+  latency.bytes_per_usec = DEFAULT_BYTES_PER_USEC;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+  {
+    if (strcmp(argv[i], "-r") == 0)
+    {
+      realtime = 1;
+    }
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+    {
+      latency.request_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+    {
+      latency.bytes_per_usec = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+    {
+      host_fs_set_root(ARCHIVE_SDMC, argv[++i]);
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i + 2 != argc)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  trace = bench_load_file(argv[i], &size, 0);
+  if (trace == NULL)
+  {
+    fprintf(stderr, "%s: cannot read\n", argv[i]);
+    return 1;
+  }
+  if (size >= sizeof(header))
+  {
+    memcpy(&header, trace, sizeof(header));
+  }
+  if (size < sizeof(header) || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+      header.size > size - sizeof(header))
+  {
+    fprintf(stderr, "%s: not a trace\n", argv[i]);
+    return 1;
+  }
+  host_fsreg_set_titles(argv[i + 1]);
+  host_fs_set_latency(&latency);
+  if (R_FAILED(loader_run_start(&thread, &loader)))
+  {
+    fprintf(stderr, "cannot start the loader\n");
+    return 1;
+  }
+
+  device_span = 0;
+  device_busy = 0;
+  host_busy = 0;
+  failed = 0;
+  n = 0;
+  begin = bench_nsec();
+  due = begin;
+  for (offset = sizeof(header); offset + sizeof(trace_record) + 4 <= sizeof(header) + header.size; offset += words * 4)
+  {
+    record = (const trace_record *)(trace + offset);
+    request = (const u32 *)(record + 1);
+    words = trace_request_words(request[0]);
+    if (offset + sizeof(trace_record) + words * 4 > sizeof(header) + header.size)
+    {
+      break;
+    }
+    offset += sizeof(trace_record);
+
+    if (n > 0)
+    {
+      device_span += record->delta;
+    }
+    due += (u64)record->delta * 1000;
+    if (realtime && bench_nsec() < due)
+    {
+      svcSleepThread(due - bench_nsec());
+    }
+    t = replay(loader, record, request, words, &mismatched);
+    stats = stats_for(request[0] >> 16, header.records);
+    if (stats != NULL)
+    {
+      stats->host[stats->count] = t;
+      stats->device[stats->count] = record->busy;
+      stats->count++;
+      stats->mismatched += mismatched;
+    }
+    failed |= mismatched;
+    host_busy += t;
+    device_busy += record->busy;
+    n++;
+    if (n == header.records)
+    {
+      device_span += record->busy;
+      break;
+    }
+  }
+  t = bench_nsec() - begin;
+  loader_run_stop(thread, loader);
+
+  // host is the replay, device what the console recorded, all in msec
+  printf("%-22s %6s %8s %8s %8s %8s %8s %8s %8s %6s\n", "command", "count", "host p50", "p90", "p99", "max",
+    "dev p50", "p99", "max", "differ");
+  for (i = 0; i < g_command_count; i++)
+  {
+    print_stats(&g_commands[i]);
+    free(g_commands[i].host);
+    free(g_commands[i].device);
+  }
+  printf("%u of %u requests replayed, %u were not recorded\n", n, header.records, header.dropped);
+  printf("busy: host %.3f ms, device %.3f ms\n", host_busy / 1e6, device_busy / 1e3);
+  printf("%s: host %.3f ms, device %.3f ms\n", realtime ? "boot path" : "back to back", t / 1e6, device_span / 1e3);
+  free(trace);
+  return failed || n != header.records;
+}
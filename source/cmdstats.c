@@ -0,0 +1,107 @@
+#include <3ds.h>
+#include <string.h>
+#include "cmdstats.h"
+#include "ifile.h"
+
+#ifndef CMDSTATS_ENABLE
+#define CMDSTATS_ENABLE 1
+#endif
+
+#define CMDSTATS_PATH "/loader/cmdstats.bin"
+
+static cmdstats_entry g_entries[CMDSTATS_COMMANDS];
+
+u64 cmdstats_begin(void)
+{
+  return CMDSTATS_ENABLE ? svcGetSystemTick() : 0;
+}
+
+static u32 bucket_of(u32 usec)
+{
+  u32 bucket;
+
+  if (usec < 2)
+  {
+    return 0;
+  }
+  bucket = 31 - __builtin_clz(usec);
+  return bucket < CMDSTATS_BUCKETS ? bucket : CMDSTATS_BUCKETS - 1;
+}
+
+void cmdstats_end(u32 header, u64 begin)
+{
+  cmdstats_entry *entry;
+  u64 usec;
+  u32 id;
+  int i;
+
+  if (!CMDSTATS_ENABLE)
+  {
+    return;
+  }
+  usec = (svcGetSystemTick() - begin) * 1000000 / SYSCLOCK_ARM11;
+  if (usec > 0xFFFFFFFF)
+  {
+    usec = 0xFFFFFFFF;
+  }
+  id = header >> 16;
+  // commands past the first CMDSTATS_COMMANDS IDs are not counted
+  for (i = 0; i < CMDSTATS_COMMANDS && g_entries[i].id != id && g_entries[i].count != 0; i++);
+  if (i == CMDSTATS_COMMANDS)
+  {
+    return;
+  }
+  entry = &g_entries[i];
+  entry->id = id;
+  entry->count++;
+  if (usec > entry->max)
+  {
+    entry->max = (u32)usec;
+  }
+  entry->buckets[bucket_of((u32)usec)]++;
+}
+
+u32 cmdstats_read(cmdstats_entry *out, u32 max)
+{
+  u32 count;
+
+  for (count = 0; count < CMDSTATS_COMMANDS && count < max && g_entries[count].count != 0; count++)
+  {
+    out[count] = g_entries[count];
+  }
+  return count;
+}
+
+Result cmdstats_dump(const cmdstats_entry *entries, u32 count)
+{
+  IFile file;
+  cmdstats_file_header header;
+  u64 total;
+  Result res;
+
+  res = IFile_OpenPath(&file, ARCHIVE_SDMC, CMDSTATS_PATH, FS_OPEN_WRITE | FS_OPEN_CREATE);
+  if (R_FAILED(res))
+  {
+    return res;
+  }
+  header.magic = CMDSTATS_MAGIC;
+  header.version = CMDSTATS_VERSION;
+  header.buckets = CMDSTATS_BUCKETS;
+  header.count = count;
+  res = IFile_SetSize(&file, 0);
+  if (R_SUCCEEDED(res))
+  {
+    res = IFile_Write(&file, &total, &header, sizeof(header), 0);
+  }
+  if (R_SUCCEEDED(res))
+  {
+    res = IFile_Write(&file, &total, (void *)entries, count * sizeof(cmdstats_entry), FS_WRITE_FLUSH);
+  }
+  IFile_Close(&file);
+  return res;
+}
+
+void cmdstats_clear(void)
+{
+  memset(g_entries, 0, sizeof(g_entries));
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// Call counts and reply latency histograms per Loader command ID, since
+// service start or the last clear.
+
+#define CMDSTATS_COMMANDS 8
+#define CMDSTATS_BUCKETS 24
+
+typedef struct
+{
+  u32 id;    // command ID, entries are taken in the order commands come in
+  u32 count;
+  u32 max;   // usec
+  // bucket 0 counts replies in under 2 usec, bucket i from 2^i usec on, the
+  // last one everything longer as well
+  u32 buckets[CMDSTATS_BUCKETS];
+} cmdstats_entry;
+
+// flags of the GetCommandStats command
+#define CMDSTATS_DUMP_SD BIT(0) // also write the entries to /loader/cmdstats.bin
+#define CMDSTATS_CLEAR BIT(1)   // start over once returned
+
+// /loader/cmdstats.bin: this header, then the entries
+#define CMDSTATS_MAGIC 0x53434C4C // "LLCS"
+#define CMDSTATS_VERSION 1
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 buckets;
+  u32 count;
+} cmdstats_file_header;
+
+// when a request came in, pass it to cmdstats_end once it is replied to
+u64 cmdstats_begin(void);
+void cmdstats_end(u32 header, u64 begin);
+
+// copies up to `max` entries in use and returns how many
+u32 cmdstats_read(cmdstats_entry *out, u32 max);
+Result cmdstats_dump(const cmdstats_entry *entries, u32 count);
+void cmdstats_clear(void);
@@ -0,0 +1,213 @@
+#include <3ds.h>
+#include <string.h>
+#include "codeload.h"
+#include "ifile.h"
+#include "lzblock.h"
+#include "lzss.h"
+#include "patcher.h"
+#include "profile.h"
+#include "worker.h"
+
+// Compressed code is decoded from its end backwards, so it is read in chunks
+// starting at the end of the file (see IFile_ReadChunked) and the decoder
+// follows the reads. Uncompressed code is searched for patches the same way.
+// Images smaller than two chunks are read in one go.
+#ifndef CODELOAD_CHUNK_SIZE
+#define CODELOAD_CHUNK_SIZE 0x10000
+#endif
+
+// compressed bytes decoded between two looks for patches in the new output
+#ifndef CODELOAD_SCAN_STEP
+#define CODELOAD_SCAN_STEP 0x8000
+#endif
+
+// Block images (see lzblock.c) are decoded a block at a time by this thread
+// and a helper on CODELOAD_BLOCK_CORE.
+#ifndef CODELOAD_BLOCK_CORE
+#define CODELOAD_BLOCK_CORE 0
+#endif
+
+#define DECODER_STACK_SIZE 0x1000
+
+typedef struct
+{
+  u8 *code;
+  u32 size;
+  lzss_state state;
+  int started;
+  int blocked; // a block image, decoded once it is all read
+  int done;
+} stream_t;
+
+typedef struct
+{
+  const lzblock_index *index;
+  u8 *code;
+  u32 next; // first block nobody took yet
+} blocks_t;
+
+static blocks_t g_blocks;
+static worker_t g_decoder;
+static u8 g_decoder_stack[DECODER_STACK_SIZE] ALIGN(8);
+
+// the decoded bytes from final up are searched for patches right away
+static void scan_final(u8 *final)
+{
+  u64 start;
+
+  start = profile_tick();
+  patch_scan_final(final);
+  profile_add(PROFILE_PATCH, start);
+}
+
+static void decoder_main(void *arg)
+{
+  blocks_t *blocks;
+  u32 block;
+
+  blocks = (blocks_t *)arg;
+  while ((block = __atomic_fetch_add(&blocks->next, 1, __ATOMIC_RELAXED)) < blocks->index->count)
+  {
+    lzblock_decode(blocks->index, blocks->code, block);
+  }
+}
+
+// returns 0 if code is not a block image
+static int decode_blocks(u8 *code, u32 size)
+{
+  lzblock_index index;
+  u64 start;
+  int started;
+
+  if (!lzblock_read_index(&index, code, size))
+  {
+    return 0;
+  }
+  start = profile_tick();
+  lzblock_place(&index, code);
+  g_blocks.index = &index;
+  g_blocks.code = code;
+  g_blocks.next = 0;
+  // the blocks are taken in turn, so a slow one does not hold up the rest
+  started = index.count > 1 && 
+    R_SUCCEEDED(worker_start(&g_decoder, decoder_main, &g_blocks, 
+      g_decoder_stack, sizeof(g_decoder_stack), 
+      worker_current_priority(), CODELOAD_BLOCK_CORE));
+  decoder_main(&g_blocks);
+  if (started)
+  {
+    worker_join(&g_decoder);
+  }
+  profile_add(PROFILE_DECOMPRESS, start);
+  scan_final(code);
+  return 1;
+}
+
+static Result read_all(IFile *file, u8 *code, u32 size)
+{
+  u64 total;
+
+  file->pos = 0;
+  return IFile_Read(file, &total, code, size);
+}
+
+// chunks come in from the end of the file, the first one is nearly a whole
+// chunk so it holds the footer and header
+static void decode_chunk(void *arg, u8 *chunk, u32 len)
+{
+  stream_t *stream;
+  u64 start;
+  u32 magic;
+
+  stream = (stream_t *)arg;
+  if (!stream->started)
+  {
+    // the blocks are moved before they are decoded, so a block image
+    // waits for the whole file
+    memcpy(&magic, stream->code + stream->size - 4, 4);
+    stream->blocked = magic == LZBLOCK_MAGIC;
+    lzss_begin(&stream->state, stream->code + stream->size);
+    stream->started = 1;
+  }
+  if (stream->blocked)
+  {
+    return;
+  }
+  if (!stream->done)
+  {
+    start = profile_tick();
+    stream->done = lzss_continue(&stream->state, chunk);
+    profile_add(PROFILE_DECOMPRESS, start);
+  }
+  // decoded bytes are final, the raw prefix below them only once it is read
+  scan_final(stream->done && chunk < stream->state.out ? chunk : stream->state.out);
+}
+
+static void scan_chunk(void *arg, u8 *chunk, u32 len)
+{
+  scan_final(chunk);
+}
+
+static Result read_streaming(IFile *file, u8 *code, u32 size, int is_compressed)
+{
+  stream_t stream;
+  u64 total;
+  Result res;
+
+  stream.code = code;
+  stream.size = size;
+  stream.started = 0;
+  stream.blocked = 0;
+  stream.done = 0;
+  file->pos = 0;
+  res = IFile_ReadChunked(file, &total, code, size, CODELOAD_CHUNK_SIZE, 1,
+    is_compressed ? decode_chunk : scan_chunk, &stream);
+  if (stream.blocked && R_SUCCEEDED(res) && !decode_blocks(code, size))
+  {
+    res = 0xC900464F;
+  }
+  return res;
+}
+
+Result codeload_read(IFile *file, u8 *code, u32 size, int is_compressed)
+{
+  Result res;
+
+  if (size >= 2 * CODELOAD_CHUNK_SIZE)
+  {
+    return read_streaming(file, code, size, is_compressed);
+  }
+  res = read_all(file, code, size);
+  if (R_SUCCEEDED(res))
+  {
+    if (is_compressed)
+    {
+      codeload_decompress(code, size);
+    }
+    else
+    {
+      scan_final(code);
+    }
+  }
+  return res;
+}
+
+void codeload_decompress(u8 *code, u32 size)
+{
+  lzss_state state;
+  u64 start;
+  int done;
+
+  if (decode_blocks(code, size))
+  {
+    return;
+  }
+  lzss_begin(&state, code + size);
+  do
+  {
+    start = profile_tick();
+    done = lzss_continue(&state, (u32)(state.in - code) > CODELOAD_SCAN_STEP ? state.in - CODELOAD_SCAN_STEP : NULL);
+    profile_add(PROFILE_DECOMPRESS, start);
+    scan_final(done ? code : state.out);
+  } while (!done);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <3ds/types.h>
+#include "ifile.h"
+
+Result codeload_read(IFile *file, u8 *code, u32 size, int is_compressed);
+// decompresses an image already read to code in one piece
+void codeload_decompress(u8 *code, u32 size);
@@ -0,0 +1,101 @@
+#include <3ds.h>
+#include <string.h>
+#include "exhcache.h"
+#include "fsreg.h"
+
+#ifndef EXHCACHE_ENTRIES
+#define EXHCACHE_ENTRIES 4
+#endif
+
+typedef struct
+{
+  u64 prog_handle; // 0 if the slot is free
+  u32 stamp;       // last use
+  exheader_header exheader;
+} exhcache_entry;
+
+static exhcache_entry g_entries[EXHCACHE_ENTRIES];
+static u32 g_stamp;
+static u32 g_hits;
+static u32 g_misses;
+
+static exhcache_entry *entry_find(u64 prog_handle)
+{
+  int i;
+
+  for (i = 0; i < EXHCACHE_ENTRIES; i++)
+  {
+    if (g_entries[i].prog_handle == prog_handle)
+    {
+      return &g_entries[i];
+    }
+  }
+  return NULL;
+}
+
+exheader_header *exhcache_find(u64 prog_handle)
+{
+  exhcache_entry *entry;
+
+  entry = prog_handle != 0 ? entry_find(prog_handle) : NULL;
+  if (entry == NULL)
+  {
+    g_misses++;
+    return NULL;
+  }
+  g_hits++;
+  entry->stamp = ++g_stamp;
+  return &entry->exheader;
+}
+
+exheader_header *exhcache_insert(u64 prog_handle)
+{
+  exhcache_entry *entry;
+  int i;
+
+  entry = entry_find(prog_handle);
+  if (entry == NULL)
+  {
+    entry = &g_entries[0];
+    for (i = 1; i < EXHCACHE_ENTRIES; i++)
+    {
+      if (g_entries[i].stamp < entry->stamp)
+      {
+        entry = &g_entries[i];
+      }
+    }
+  }
+  entry->prog_handle = prog_handle;
+  entry->stamp = ++g_stamp;
+  return &entry->exheader;
+}
+
+void exhcache_drop(u64 prog_handle)
+{
+  exhcache_entry *entry;
+
+  entry = entry_find(prog_handle);
+  if (entry != NULL)
+  {
+    entry->prog_handle = 0;
+    entry->stamp = 0;
+  }
+}
+
+u32 exhcache_fetch(u64 prog_handle, const u64 *progids, u32 count, exheader_header *exheaders)
+{
+  u32 i;
+
+  if (R_FAILED(FSREG_GetProgramInfo(exheaders, count, prog_handle)))
+  {
+    return 0;
+  }
+  for (i = 0; i < count && exheaders[i].arm11systemlocalcaps.programid == progids[i]; i++);
+  return i;
+}
+
+void exhcache_stats(u32 *hits, u32 *misses)
+{
+  *hits = g_hits;
+  *misses = g_misses;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <3ds/types.h>
+#include "exheader.h"
+
+// the exheaders of the last few programs pm asked about, keyed by prog_handle
+
+// the cached exheader of prog_handle or NULL, counts a hit or a miss
+exheader_header *exhcache_find(u64 prog_handle);
+// a slot for prog_handle to fill in, replaces the least recently used one
+exheader_header *exhcache_insert(u64 prog_handle);
+void exhcache_drop(u64 prog_handle);
+// fetches the exheaders of prog_handle and the count - 1 handles after it
+// with a single FSREG request. FS does not promise that a run of programs
+// got consecutive handles, so entry i is checked against progids[i]: returns
+// how many from the first on belong to their program. The cache is left
+// alone, so this can run on another thread.
+u32 exhcache_fetch(u64 prog_handle, const u64 *progids, u32 count, exheader_header *exheaders);
+void exhcache_stats(u32 *hits, u32 *misses);
@@ -0,0 +1,132 @@
+#include <3ds.h>
+#include "fsprio.h"
+#include "fsldr.h"
+#include "ifile.h"
+
+// fsldrInit sets one fs:LDR priority for everything the loader reads. With
+// this on, a load is read at the priority of the first rule its program
+// matches, by program ID category and memory type, so applications and
+// applets are not held up behind sysmodule loads. Between loads it is back
+// to FSPRIO_BASE. The rules come from /loader/fsprio.bin if SD has it, a
+// missing or damaged file keeps the built-in ones. It is looked for on every
+// load until SD is up.
+//
+// A prefetch (see loader.c) reads at whatever priority is in force when it
+// runs.
+#ifndef FSPRIO_ENABLE
+#define FSPRIO_ENABLE 0
+#endif
+
+#ifndef FSPRIO_BASE
+#define FSPRIO_BASE 0
+#endif
+
+#ifndef FSPRIO_FOREGROUND
+#define FSPRIO_FOREGROUND 0
+#endif
+
+#ifndef FSPRIO_BACKGROUND
+#define FSPRIO_BACKGROUND 1
+#endif
+
+#define FSPRIO_RULES 16
+#define FSPRIO_PATH "/loader/fsprio.bin"
+
+static const fsprio_rule g_builtin[] =
+{
+  { 0x00040000, 0xFFFFFFFF, FSPRIO_MEMTYPE_ANY, FSPRIO_FOREGROUND }, // applications
+  { 0x00040030, 0xFFFFFFFF, FSPRIO_MEMTYPE_ANY, FSPRIO_FOREGROUND }, // applets
+  { 0, 0, FSPRIO_MEMTYPE_APPLICATION, FSPRIO_FOREGROUND },
+  { 0, 0, FSPRIO_MEMTYPE_ANY, FSPRIO_BACKGROUND },
+};
+
+static fsprio_rule g_file[FSPRIO_RULES];
+static const fsprio_rule *g_rules = g_builtin;
+static u32 g_count = sizeof(g_builtin) / sizeof(g_builtin[0]);
+static int g_loaded;
+static u32 g_current = FSPRIO_BASE;
+
+static void load_rules(void)
+{
+  fsprio_header header;
+  IFile file;
+  u64 size;
+  u64 total;
+  Result res;
+
+  // fails until SD is mounted
+  res = IFile_OpenPath(&file, ARCHIVE_SDMC, FSPRIO_PATH, FS_OPEN_READ);
+  if (res == IFILE_NOT_FOUND)
+  {
+    g_loaded = 1;
+    return;
+  }
+  if (R_FAILED(res))
+  {
+    return;
+  }
+  res = IFile_GetSize(&file, &size);
+  if (R_SUCCEEDED(res) && size >= sizeof(header))
+  {
+    res = IFile_Read(&file, &total, &header, sizeof(header));
+    if (R_SUCCEEDED(res) && total == sizeof(header) && header.magic == FSPRIO_MAGIC &&
+        header.version == FSPRIO_VERSION && header.count > 0 && header.count <= FSPRIO_RULES &&
+        size == sizeof(header) + header.count * sizeof(fsprio_rule))
+    {
+      res = IFile_Read(&file, &total, g_file, header.count * sizeof(fsprio_rule));
+      if (R_SUCCEEDED(res) && total == header.count * sizeof(fsprio_rule))
+      {
+        g_rules = g_file;
+        g_count = header.count;
+      }
+    }
+  }
+  IFile_Close(&file);
+  // a damaged file is not read again either
+  g_loaded = 1;
+}
+
+static void set_priority(u32 priority)
+{
+  if (priority != g_current && R_SUCCEEDED(FSLDR_SetPriority(priority)))
+  {
+    g_current = priority;
+  }
+}
+
+void fsprio_begin(u64 progid, u32 flags)
+{
+  const fsprio_rule *rule;
+  u32 category;
+  u32 memtype;
+  u32 i;
+
+  if (!FSPRIO_ENABLE)
+  {
+    return;
+  }
+  if (!g_loaded)
+  {
+    load_rules();
+  }
+  category = (u32)(progid >> 32);
+  memtype = (flags >> 8) & 0xF;
+  for (i = 0; i < g_count; i++)
+  {
+    rule = &g_rules[i];
+    if ((category & rule->mask) == rule->category &&
+        (rule->memtype == FSPRIO_MEMTYPE_ANY || rule->memtype == memtype))
+    {
+      set_priority(rule->priority);
+      return;
+    }
+  }
+}
+
+void fsprio_end(void)
+{
+  if (FSPRIO_ENABLE)
+  {
+    set_priority(FSPRIO_BASE);
+  }
+}
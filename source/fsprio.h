@@ -0,0 +1,35 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// /loader/fsprio.bin, written by host/fsprio_pack.c, little endian:
+//   fsprio_header
+//   fsprio_rule[count], the first rule a program matches gives its priority
+#define FSPRIO_MAGIC 0x50464C4C // "LLFP"
+#define FSPRIO_VERSION 1
+
+// memory types of the kernel flags
+#define FSPRIO_MEMTYPE_ANY 0
+#define FSPRIO_MEMTYPE_APPLICATION 1
+#define FSPRIO_MEMTYPE_SYSTEM 2
+#define FSPRIO_MEMTYPE_BASE 3
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 count;
+} fsprio_header;
+
+typedef struct
+{
+  u32 category; // the upper half of the program ID, after mask
+  u32 mask;     // 0 matches any program
+  u32 memtype;
+  u32 priority; // for FSLDR_SetPriority
+} fsprio_rule;
+
+// sets the fs:LDR priority for loading progid, flags are its kernel flags
+void fsprio_begin(u64 progid, u32 flags);
+// back to the priority fsldrInit set
+void fsprio_end(void);
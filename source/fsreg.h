@@ -7,6 +7,7 @@ Result fsregInit(void);
 void fsregExit(void);
 Result FSREG_CheckHostLoadId(u64 prog_handle);
 Result FSREG_LoadProgram(u64 *prog_handle, FS_ProgramInfo *title);
+// entry_count exheaders, of prog_handle and the handles FS gave out after it
 Result FSREG_GetProgramInfo(exheader_header *exheader, u32 entry_count, u64 prog_handle);
 Result FSREG_UnloadProgram(u64 prog_handle);
 Result FSREG_Unregister(u32 pid);
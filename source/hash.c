@@ -0,0 +1,44 @@
+#include <3ds/types.h>
+#include <string.h>
+#include "hash.h"
+
+#define ROTL32(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+u32 hash32(u32 seed, const void *data, u32 len)
+{
+  const u8 *p;
+  u32 h;
+  u32 k;
+  u32 i;
+
+  p = (const u8 *)data;
+  h = seed;
+  for (i = 0; i + 4 <= len; i += 4)
+  {
+    memcpy(&k, p + i, 4);
+    k *= 0xCC9E2D51;
+    k = ROTL32(k, 15);
+    k *= 0x1B873593;
+    h ^= k;
+    h = ROTL32(h, 13);
+    h = h * 5 + 0xE6546B64;
+  }
+  k = 0;
+  switch (len & 3)
+  {
+    case 3: k ^= p[i + 2] << 16;
+    case 2: k ^= p[i + 1] << 8;
+    case 1: k ^= p[i];
+      k *= 0xCC9E2D51;
+      k = ROTL32(k, 15);
+      k *= 0x1B873593;
+      h ^= k;
+  }
+  h ^= len;
+  h ^= h >> 16;
+  h *= 0x85EBCA6B;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35;
+  h ^= h >> 16;
+  return h;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// 32-bit MurmurHash3, fast on word-aligned data and not cryptographic
+u32 hash32(u32 seed, const void *data, u32 len);
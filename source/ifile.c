@@ -1,6 +1,55 @@
 #include <3ds.h>
+#include <string.h>
 #include "ifile.h"
 #include "fsldr.h"
+#include "worker.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 255
+#endif
+
+// Reads and writes are cut into FS requests of at most IFILE_CHUNK_SIZE
+// bytes, each after the first starting at a multiple of IFILE_ALIGN in the
+// file. 0 leaves a transfer one request, short ones aside.
+#ifndef IFILE_CHUNK_SIZE
+#define IFILE_CHUNK_SIZE 0
+#endif
+
+#ifndef IFILE_ALIGN
+#define IFILE_ALIGN 0x200
+#endif
+
+#if IFILE_CHUNK_SIZE % IFILE_ALIGN != 0
+#error IFILE_CHUNK_SIZE must be a multiple of IFILE_ALIGN
+#endif
+
+#define HELPER_STACK_SIZE 0x1000
+
+// A chunked transfer moves one chunk on a helper thread while the caller
+// works on the one next to it. There is one helper, a transfer that finds it
+// taken runs its chunks one after the other on the calling thread.
+typedef struct
+{
+  IFile *file;
+  u8 *buffer;
+  u64 base; // file offset of buffer
+  u32 len;
+  u32 chunk;
+  int backwards;
+  int write;
+  u32 flags;
+  u32 produced; // chunks the caller is done with, writes only
+  u32 moved;    // chunks the helper transferred
+  int finished; // the helper is out of chunks or failed
+  u64 total;
+  Result res;
+  Handle done;  // the helper moved a chunk or finished
+  Handle ready; // the caller produced a chunk
+} transfer_t;
+
+static worker_t g_helper;
+static u8 g_helper_stack[HELPER_STACK_SIZE] ALIGN(8);
+static int g_helper_busy;
 
 Result IFile_Open(IFile *file, FS_Archive archive, FS_Path path, u32 flags)
 {
@@ -12,6 +61,23 @@ Result IFile_Open(IFile *file, FS_Archive archive, FS_Path path, u32 flags)
   return res;
 }
 
+Result IFile_OpenPath(IFile *file, FS_ArchiveID id, const char *path, u32 flags)
+{
+  FS_Archive archive;
+  FS_Path ppath;
+  size_t len;
+
+  len = strnlen(path, PATH_MAX);
+  archive.id = id;
+  archive.lowPath.type = PATH_EMPTY;
+  archive.lowPath.size = 1;
+  archive.lowPath.data = (u8 *)"";
+  ppath.type = PATH_ASCII;
+  ppath.data = path;
+  ppath.size = len+1;
+  return IFile_Open(file, archive, ppath, flags);
+}
+
 Result IFile_Close(IFile *file)
 {
   return FSFILE_Close(file->handle);
@@ -26,80 +92,304 @@ Result IFile_GetSize(IFile *file, u64 *size)
   return res;
 }
 
-Result IFile_Read(IFile *file, u64 *total, void *buffer, u32 len)
+Result IFile_SetSize(IFile *file, u64 size)
 {
-  u32 read;
-  u32 left;
-  char *buf;
-  u64 cur;
   Result res;
 
-  if (len == 0)
+  res = FSFILE_SetSize(file->handle, size);
+  if (R_SUCCEEDED(res))
   {
-    *total = 0;
-    return 0;
+    file->size = size;
   }
+  return res;
+}
+
+// the size of the next FS request of a transfer at pos
+static u32 request_size(u64 pos, u32 len)
+{
+  u32 max;
+
+  if (IFILE_CHUNK_SIZE == 0)
+  {
+    return len;
+  }
+  max = IFILE_CHUNK_SIZE - (u32)(pos & (IFILE_ALIGN - 1));
+  return len < max ? len : max;
+}
+
+static Result transfer(IFile *file, u64 *total, u8 *buf, u32 len, u32 flags, int write)
+{
+  u32 done;
+  u32 n;
+  u64 cur;
+  Result res;
 
-  buf = (char *)buffer;
   cur = 0;
-  left = len;
-  while (1)
+  res = 0;
+  while (len > 0)
   {
-    res = FSFILE_Read(file->handle, &read, file->pos, buf, left);
+    n = request_size(file->pos, len);
+    if (write)
+    {
+      res = FSFILE_Write(file->handle, &done, file->pos, buf, n, flags);
+    }
+    else
+    {
+      res = FSFILE_Read(file->handle, &done, file->pos, buf, n);
+    }
     if (R_FAILED(res))
     {
       break;
     }
 
-    cur += read;
-    file->pos += read;
-    if (read == left)
+    cur += done;
+    file->pos += done;
+    if (done == 0) // end of file
     {
       break;
     }
-    buf += read;
-    left -= read;
+    buf += done;
+    len -= done;
   }
 
   *total = cur;
   return res;
 }
 
+Result IFile_Read(IFile *file, u64 *total, void *buffer, u32 len)
+{
+  return transfer(file, total, (u8 *)buffer, len, 0, 0);
+}
+
 Result IFile_Write(IFile *file, u64 *total, void *buffer, u32 len, u32 flags)
 {
-  u32 written;
-  u32 left;
-  char *buf;
-  u64 cur;
-  Result res;
+  return transfer(file, total, (u8 *)buffer, len, flags, 1);
+}
 
-  if (len == 0)
+// Steps [*lo, *hi) to the next chunk, returns 0 after the last one. Chunks
+// after the first start (or end, going backwards) at a multiple of
+// IFILE_ALIGN in the file, so the first one is the only short one.
+static int next_chunk(const transfer_t *t, u32 *lo, u32 *hi)
+{
+  u64 at;
+
+  if (t->backwards)
   {
-    *total = 0;
-    return 0;
+    if (*lo == 0)
+    {
+      return 0;
+    }
+    *hi = *lo;
+    at = t->base + *hi;
+    at = at > t->chunk ? (at - t->chunk + IFILE_ALIGN - 1) & ~(u64)(IFILE_ALIGN - 1) : 0;
+    *lo = at > t->base ? (u32)(at - t->base) : 0;
+  }
+  else
+  {
+    if (*hi == t->len)
+    {
+      return 0;
+    }
+    *lo = *hi;
+    at = (t->base + *lo + t->chunk) & ~(u64)(IFILE_ALIGN - 1);
+    *hi = at - t->base < t->len ? (u32)(at - t->base) : t->len;
   }
+  return 1;
+}
 
-  buf = (char *)buffer;
-  cur = 0;
-  left = len;
-  while (1)
+static void first_chunk(const transfer_t *t, u32 *lo, u32 *hi)
+{
+  *lo = t->backwards ? t->len : 0;
+  *hi = *lo;
+}
+
+// returns 0 once the transfer is over, a short chunk ends it
+static int move_chunk(transfer_t *t, u32 lo, u32 hi)
+{
+  u64 total;
+
+  t->file->pos = t->base + lo;
+  t->res = transfer(t->file, &total, t->buffer + lo, hi - lo, t->flags, t->write);
+  t->total += total;
+  return R_SUCCEEDED(t->res) && total == hi - lo;
+}
+
+static void helper_main(void *arg)
+{
+  transfer_t *t;
+  u32 lo;
+  u32 hi;
+  u32 i;
+
+  t = (transfer_t *)arg;
+  first_chunk(t, &lo, &hi);
+  for (i = 0; next_chunk(t, &lo, &hi); i++)
   {
-    res = FSFILE_Write(file->handle, &written, file->pos, buf, left, flags);
-    if (R_FAILED(res))
+    while (t->write && __atomic_load_n(&t->produced, __ATOMIC_ACQUIRE) <= i)
+    {
+      svcWaitSynchronization(t->ready, U64_MAX);
+    }
+    if (!move_chunk(t, lo, hi))
     {
       break;
     }
+    __atomic_store_n(&t->moved, i + 1, __ATOMIC_RELEASE);
+    svcSignalEvent(t->done);
+  }
+  __atomic_store_n(&t->finished, 1, __ATOMIC_RELEASE);
+  svcSignalEvent(t->done);
+}
 
-    cur += written;
-    file->pos += written;
-    if (written == left)
+// returns 0 if the helper could not be had
+static int start_helper(transfer_t *t)
+{
+  if (__atomic_exchange_n(&g_helper_busy, 1, __ATOMIC_ACQUIRE))
+  {
+    return 0;
+  }
+  if (R_SUCCEEDED(svcCreateEvent(&t->done, RESET_ONESHOT)))
+  {
+    if (!t->write || R_SUCCEEDED(svcCreateEvent(&t->ready, RESET_ONESHOT)))
     {
-      break;
+      // one priority above the caller, so the next request goes out as soon
+      // as the last one is served
+      if (R_SUCCEEDED(worker_start(&g_helper, helper_main, t, g_helper_stack, sizeof(g_helper_stack),
+            worker_current_priority() - 1, -2)))
+      {
+        return 1;
+      }
+      if (t->write)
+      {
+        svcCloseHandle(t->ready);
+      }
     }
-    buf += written;
-    left -= written;
+    svcCloseHandle(t->done);
   }
+  __atomic_store_n(&g_helper_busy, 0, __ATOMIC_RELEASE);
+  return 0;
+}
 
-  *total = cur;
-  return res;
+static void stop_helper(transfer_t *t)
+{
+  worker_join(&g_helper);
+  svcCloseHandle(t->done);
+  if (t->write)
+  {
+    svcCloseHandle(t->ready);
+  }
+  __atomic_store_n(&g_helper_busy, 0, __ATOMIC_RELEASE);
+}
+
+static Result run_chunked(transfer_t *t, u64 *total, IFile_ChunkFunc func, void *arg)
+{
+  u32 lo;
+  u32 hi;
+  u32 i;
+  int threaded;
+
+  t->chunk = (t->chunk + IFILE_ALIGN - 1) & ~(IFILE_ALIGN - 1);
+  if (t->chunk == 0)
+  {
+    t->chunk = IFILE_ALIGN;
+  }
+  t->base = t->file->pos;
+  t->produced = 0;
+  t->moved = 0;
+  t->finished = 0;
+  t->total = 0;
+  t->res = 0;
+  threaded = t->len > t->chunk && start_helper(t);
+
+  first_chunk(t, &lo, &hi);
+  for (i = 0; next_chunk(t, &lo, &hi); i++)
+  {
+    if (!threaded)
+    {
+      if (t->write && func != NULL)
+      {
+        func(arg, t->buffer + lo, hi - lo);
+      }
+      if (!move_chunk(t, lo, hi))
+      {
+        break;
+      }
+      if (!t->write && func != NULL)
+      {
+        func(arg, t->buffer + lo, hi - lo);
+      }
+    }
+    else if (t->write)
+    {
+      if (__atomic_load_n(&t->finished, __ATOMIC_ACQUIRE))
+      {
+        break;
+      }
+      if (func != NULL)
+      {
+        func(arg, t->buffer + lo, hi - lo);
+      }
+      __atomic_store_n(&t->produced, i + 1, __ATOMIC_RELEASE);
+      svcSignalEvent(t->ready);
+    }
+    else
+    {
+      while (__atomic_load_n(&t->moved, __ATOMIC_ACQUIRE) <= i && !__atomic_load_n(&t->finished, __ATOMIC_ACQUIRE))
+      {
+        svcWaitSynchronization(t->done, U64_MAX);
+      }
+      if (__atomic_load_n(&t->moved, __ATOMIC_ACQUIRE) <= i)
+      {
+        break;
+      }
+      if (func != NULL)
+      {
+        func(arg, t->buffer + lo, hi - lo);
+      }
+    }
+  }
+
+  if (threaded)
+  {
+    stop_helper(t);
+  }
+  t->file->pos = t->base + (t->backwards ? t->len : t->total);
+  *total = t->total;
+  return t->res;
+}
+
+// Reads len bytes at file->pos into buffer in chunks of about chunk bytes,
+// from the last one to the first if backwards, handing each to consume.
+// The helper reads ahead of consume. The transfer stops at a failed or short
+// read, *total says how much was read.
+Result IFile_ReadChunked(IFile *file, u64 *total, void *buffer, u32 len, u32 chunk, int backwards,
+  IFile_ChunkFunc consume, void *arg)
+{
+  transfer_t t;
+
+  t.file = file;
+  t.buffer = (u8 *)buffer;
+  t.len = len;
+  t.chunk = chunk;
+  t.backwards = backwards;
+  t.write = 0;
+  t.flags = 0;
+  return run_chunked(&t, total, consume, arg);
+}
+
+// Writes len bytes from buffer to file->pos in chunks of about chunk bytes,
+// each one after produce filled it in. The helper writes a chunk while
+// produce works on the next.
+Result IFile_WriteChunked(IFile *file, u64 *total, void *buffer, u32 len, u32 flags, u32 chunk,
+  IFile_ChunkFunc produce, void *arg)
+{
+  transfer_t t;
+
+  t.file = file;
+  t.buffer = (u8 *)buffer;
+  t.len = len;
+  t.chunk = chunk;
+  t.backwards = 0;
+  t.write = 1;
+  t.flags = flags;
+  return run_chunked(&t, total, produce, arg);
 }
@@ -9,8 +9,23 @@ typedef struct
   u64 size;
 } IFile;
 
+// what opening a file returns once its archive is mounted but the file, or a
+// directory on its path, does not exist
+#define IFILE_NOT_FOUND 0xC8804478
+
+// Called on the calling thread with each chunk of a chunked transfer, in the
+// order they are transferred: a read's once it is in the buffer, a write's
+// before it is written.
+typedef void (*IFile_ChunkFunc)(void *arg, u8 *chunk, u32 len);
+
 Result IFile_Open(IFile *file, FS_Archive archive, FS_Path path, u32 flags);
+Result IFile_OpenPath(IFile *file, FS_ArchiveID id, const char *path, u32 flags);
 Result IFile_Close(IFile *file);
 Result IFile_GetSize(IFile *file, u64 *size);
+Result IFile_SetSize(IFile *file, u64 size);
 Result IFile_Read(IFile *file, u64 *total, void *buffer, u32 len);
 Result IFile_Write(IFile *file, u64 *total, void *buffer, u32 len, u32 flags);
+Result IFile_ReadChunked(IFile *file, u64 *total, void *buffer, u32 len, u32 chunk, int backwards,
+  IFile_ChunkFunc consume, void *arg);
+Result IFile_WriteChunked(IFile *file, u64 *total, void *buffer, u32 len, u32 flags, u32 chunk,
+  IFile_ChunkFunc produce, void *arg);
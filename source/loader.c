@@ -1,99 +1,117 @@
 #include <3ds.h>
 #include <string.h>
 #include <sys/iosupport.h>
+#include "loader.h"
 #include "patcher.h"
+#include "codeload.h"
+#include "cmdstats.h"
 #include "exheader.h"
+#include "exhcache.h"
 #include "ifile.h"
 #include "fsldr.h"
+#include "fsprio.h"
 #include "fsreg.h"
+#include "profile.h"
 #include "pxipm.h"
 #include "srvsys.h"
+#include "trace.h"
+#include "warmup.h"
+#include "worker.h"
 
+#ifndef MAX_SESSIONS
 #define MAX_SESSIONS 1
+#endif
+
+// LoadProcess runs on a worker thread, so other sessions and notifications
+// are served while a process loads
+#ifndef LOAD_WORKER_ENABLE
+#define LOAD_WORKER_ENABLE 0
+#endif
+
+// the worker's core, -2 is the loader's ideal core
+#ifndef LOAD_WORKER_CORE
+#define LOAD_WORKER_CORE -2
+#endif
+
+#define LOAD_WORKER_STACK_SIZE 0x2000
+
+#ifndef PREFETCH_ENABLE
+#define PREFETCH_ENABLE 0
+#endif
+
+#define PREFETCH_STACK_SIZE 0x1000
 
 const char CODE_PATH[] = {0x01, 0x00, 0x00, 0x00, 0x2E, 0x63, 0x6F, 0x64, 0x65, 0x00, 0x00, 0x00};
 
+static Handle g_handles[MAX_SESSIONS+2];
+static int g_active_handles;
+static char g_ret_buf[1024] ALIGN(8); // only replied with by the command thread
+static Handle g_lock; // the state below, while a worker loads
+
 typedef struct
 {
-  u32 text_addr;
-  u32 text_size;
-  u32 ro_addr;
-  u32 ro_size;
-  u32 data_addr;
-  u32 data_size;
-  u32 total_size;
-} prog_addrs_t;
+  u64 prog_handle;      // 0 if nothing is prefetched
+  Result res;           // the rest is only valid if this succeeded
+  prog_addrs_t shared;  // process memory with .code read to its start
+  IFile file;           // .code, still open
+  u64 size;
+  Handle exheader_done; // signaled once the exheader is cached
+} prefetch_t;
 
-static Handle g_handles[MAX_SESSIONS+2];
-static int g_active_handles;
-static u64 g_cached_prog_handle;
-static exheader_header g_exheader;
-static char g_ret_buf[1024];
-
-static int lzss_decompress(u8 *end)
-{
-  unsigned int v1; // r1@2
-  u8 *v2; // r2@2
-  u8 *v3; // r3@2
-  u8 *v4; // r1@2
-  char v5; // r5@4
-  char v6; // t1@4
-  signed int v7; // r6@4
-  int v9; // t1@7
-  u8 *v11; // r3@8
-  int v12; // r12@8
-  int v13; // t1@8
-  int v14; // t1@8
-  unsigned int v15; // r7@8
-  int v16; // r12@8
-  int ret;
+static prefetch_t g_prefetch;
+static int g_prefetch_running;
+static worker_t g_prefetch_worker;
+static u8 g_prefetch_stack[PREFETCH_STACK_SIZE] ALIGN(8);
 
-  ret = 0;
-  if ( end )
+// what one LoadProcess works on, apart from the command thread's state
+typedef struct
+{
+  Handle session;           // the worker replies here, 0 if it is idle
+  int closed;               // the client went away during the load
+  u64 prog_handle;
+  u64 progid;
+  exheader_header exheader; // a copy, the cache may drop it meanwhile
+  prog_addrs_t vaddr;
+  prog_addrs_t shared;
+  u32 data_mem_size;
+  prefetch_t prefetch;
+  int prefetched;
+  u32 trace;
+  u64 received;
+} load_job;
+
+static load_job g_load_job;
+static int g_load_running;
+static worker_t g_load_worker;
+static u8 g_load_stack[LOAD_WORKER_STACK_SIZE] ALIGN(8);
+
+static void state_lock(void)
+{
+  if (LOAD_WORKER_ENABLE)
   {
-    v1 = *((u32 *)end - 2);
-    v2 = &end[*((u32 *)end - 1)];
-    v3 = &end[-(v1 >> 24)];
-    v4 = &end[-(v1 & 0xFFFFFF)];
-    while ( v3 > v4 )
-    {
-      v6 = *(v3-- - 1);
-      v5 = v6;
-      v7 = 8;
-      while ( 1 )
-      {
-        if ( (v7-- < 1) )
-          break;
-        if ( v5 & 0x80 )
-        {
-          v13 = *(v3 - 1);
-          v11 = v3 - 1;
-          v12 = v13;
-          v14 = *(v11 - 1);
-          v3 = v11 - 1;
-          v15 = ((v14 | (v12 << 8)) & 0xFFFF0FFF) + 2;
-          v16 = v12 + 32;
-          do
-          {
-            ret = v2[v15];
-            *(v2-- - 1) = ret;
-            v16 -= 16;
-          }
-          while ( !(v16 < 0) );
-        }
-        else
-        {
-          v9 = *(v3-- - 1);
-          ret = v9;
-          *(v2-- - 1) = v9;
-        }
-        v5 *= 2;
-        if ( v3 <= v4 )
-          return ret;
-      }
-    }
+    svcWaitSynchronization(g_lock, U64_MAX);
+  }
+}
+
+static void state_unlock(void)
+{
+  if (LOAD_WORKER_ENABLE)
+  {
+    svcReleaseMutex(g_lock);
   }
-  return ret;
+}
+
+// writes the trace records trace_take set aside, without the state lock so
+// the other thread's commands do not wait on SD
+static Result write_trace(void)
+{
+  Result res;
+
+  res = trace_write();
+  state_lock();
+  trace_written(res);
+  state_unlock();
+  return res;
 }
 
 static Result allocate_shared_mem(prog_addrs_t *shared, prog_addrs_t *vaddr, int flags)
@@ -107,14 +125,11 @@ static Result allocate_shared_mem(prog_addrs_t *shared, prog_addrs_t *vaddr, int
   return svcControlMemory(&dummy, shared->text_addr, 0, shared->total_size << 12, (flags & 0xF00) | MEMOP_ALLOC, MEMPERM_READ | MEMPERM_WRITE);
 }
 
-static Result load_code(u64 progid, prog_addrs_t *shared, u64 prog_handle, int is_compressed)
+static Result open_code(IFile *file, u64 prog_handle, u64 *size)
 {
-  IFile file;
   FS_Archive archive;
   FS_Path path;
   Result res;
-  u64 size;
-  u64 total;
 
   archive.id = ARCHIVE_SAVEDATA_AND_CONTENT2;
   archive.lowPath.type = PATH_BINARY;
@@ -124,16 +139,75 @@ static Result load_code(u64 progid, prog_addrs_t *shared, u64 prog_handle, int i
   path.type = PATH_BINARY;
   path.data = CODE_PATH;
   path.size = sizeof(CODE_PATH);
-  if (R_FAILED(IFile_Open(&file, archive, path, FS_OPEN_READ)))
+  res = IFile_Open(file, archive, path, FS_OPEN_READ);
+  if (R_FAILED(res))
   {
-    svcBreak(USERBREAK_ASSERT);
+    return res;
   }
 
   // get file size
-  if (R_FAILED(IFile_GetSize(&file, &size)))
+  res = IFile_GetSize(file, size);
+  if (R_FAILED(res))
   {
-    IFile_Close(&file);
-    svcBreak(USERBREAK_ASSERT);
+    IFile_Close(file);
+  }
+  return res;
+}
+
+// the memory region from the kernel caps and where the segments go
+static Result get_layout(const exheader_header *exheader, prog_addrs_t *vaddr, u32 *flags, u32 *data_mem_size)
+{
+  u32 desc;
+  int i;
+
+  // get kernel flags
+  *flags = 0;
+  for (i = 0; i < 28; i++)
+  {
+    desc = exheader->arm11kernelcaps.descriptors[i];
+    if (0x1FE == desc >> 23)
+    {
+      *flags = desc & 0xF00;
+    }
+  }
+  if (*flags == 0)
+  {
+    return MAKERESULT(RL_PERMANENT, RS_INVALIDARG, 1, 2);
+  }
+
+  vaddr->text_addr = exheader->codesetinfo.text.address;
+  vaddr->text_size = (exheader->codesetinfo.text.codesize + 4095) >> 12;
+  vaddr->ro_addr = exheader->codesetinfo.ro.address;
+  vaddr->ro_size = (exheader->codesetinfo.ro.codesize + 4095) >> 12;
+  vaddr->data_addr = exheader->codesetinfo.data.address;
+  vaddr->data_size = (exheader->codesetinfo.data.codesize + 4095) >> 12;
+  *data_mem_size = (exheader->codesetinfo.data.codesize + exheader->codesetinfo.bsssize + 4095) >> 12;
+  vaddr->total_size = vaddr->text_size + vaddr->ro_size + vaddr->data_size;
+  return 0;
+}
+
+// prefetch is the .code pm registered, already read to shared, or NULL
+static Result load_code(u64 progid, const exheader_header *exheader, prog_addrs_t *shared, u64 prog_handle, int is_compressed, prefetch_t *prefetch)
+{
+  IFile file;
+  Result res;
+  u64 size;
+  u64 start;
+  int patched;
+
+  if (prefetch != NULL)
+  {
+    file = prefetch->file;
+    size = prefetch->size;
+  }
+  else
+  {
+    start = profile_tick();
+    if (R_FAILED(open_code(&file, prog_handle, &size)))
+    {
+      svcBreak(USERBREAK_ASSERT);
+    }
+    profile_add(PROFILE_OPEN, start);
   }
 
   // check size
@@ -143,23 +217,39 @@ static Result load_code(u64 progid, prog_addrs_t *shared, u64 prog_handle, int i
     return 0xC900464F;
   }
 
-  // read code
-  res = IFile_Read(&file, &total, (void *)shared->text_addr, size);
+  // read and decompress code
+  start = profile_tick();
+  patched = patch_needed(progid);
+  if (patched)
+  {
+    patch_scan_begin(progid, shared, &exheader->codesetinfo);
+  }
+  if (prefetch != NULL)
+  {
+    res = 0;
+    if (is_compressed)
+    {
+      codeload_decompress((u8 *)shared->text_addr, size);
+    }
+  }
+  else
+  {
+    res = codeload_read(&file, (u8 *)shared->text_addr, size, is_compressed);
+  }
   IFile_Close(&file); // done reading
   if (R_FAILED(res))
   {
     svcBreak(USERBREAK_ASSERT);
   }
+  profile_add(PROFILE_READ, start);
 
-  // decompress
-  if (is_compressed)
+  // patch
+  if (patched)
   {
-    lzss_decompress((u8 *)shared->text_addr + size);
+    start = profile_tick();
+    patch_code(progid, shared, &exheader->codesetinfo);
+    profile_add(PROFILE_PATCH, start);
   }
-
-  // patch
-  patch_code(progid, (u8 *)shared->text_addr, shared->total_size << 12);
-
   return 0;
 }
 
@@ -187,80 +277,231 @@ static Result loader_GetProgramInfo(exheader_header *exheader, u64 prog_handle)
   }
 }
 
-static Result loader_LoadProcess(Handle *process, u64 prog_handle)
+// the exheader of prog_handle, from the cache when pm asked about it lately
+static Result get_exheader(exheader_header **exheader, u64 prog_handle)
 {
   Result res;
-  int count;
-  u32 flags;
-  u32 desc;
-  u32 dummy;
-  prog_addrs_t shared_addr;
+
+  *exheader = exhcache_find(prog_handle);
+  if (*exheader != NULL)
+  {
+    return 0;
+  }
+  *exheader = exhcache_insert(prog_handle);
+  res = loader_GetProgramInfo(*exheader, prog_handle);
+  if (R_FAILED(res))
+  {
+    exhcache_drop(prog_handle);
+    *exheader = NULL;
+  }
+  return res;
+}
+
+// Prefetch: after pm registers a program it still has bookkeeping to do
+// before it asks for the exheader and loads the process, so the exheader and
+// .code are fetched in the meantime. .code is read to the start of the
+// process memory, the buffer load_code would read it to. The exheader cache
+// is only touched by one thread at a time, commands that use it wait for
+// the exheader first.
+static void prefetch_main(void *arg)
+{
+  prefetch_t *prefetch;
+  exheader_header *exheader;
   prog_addrs_t vaddr;
-  Handle codeset;
-  CodeSetInfo codesetinfo;
   u32 data_mem_size;
-  u64 progid;
+  u32 flags;
+  u32 dummy;
+  u64 total;
+  Result res;
 
-  // make sure the cached info corrosponds to the current prog_handle
-  if (g_cached_prog_handle != prog_handle)
+  prefetch = (prefetch_t *)arg;
+  res = get_exheader(&exheader, prefetch->prog_handle);
+  if (R_SUCCEEDED(res))
   {
-    res = loader_GetProgramInfo(&g_exheader, prog_handle);
-    g_cached_prog_handle = prog_handle;
-    if (res < 0)
+    res = get_layout(exheader, &vaddr, &flags, &data_mem_size);
+  }
+  svcSignalEvent(prefetch->exheader_done);
+  if (R_SUCCEEDED(res))
+  {
+    res = allocate_shared_mem(&prefetch->shared, &vaddr, flags);
+  }
+  if (R_SUCCEEDED(res))
+  {
+    res = open_code(&prefetch->file, prefetch->prog_handle, &prefetch->size);
+    if (R_SUCCEEDED(res))
+    {
+      if (prefetch->size > (u64)prefetch->shared.total_size << 12)
+      {
+        res = 0xC900464F;
+      }
+      else
+      {
+        prefetch->file.pos = 0;
+        res = IFile_Read(&prefetch->file, &total, (void *)prefetch->shared.text_addr, prefetch->size);
+      }
+      if (R_FAILED(res))
+      {
+        IFile_Close(&prefetch->file);
+      }
+    }
+    if (R_FAILED(res))
     {
-      g_cached_prog_handle = 0;
-      return res;
+      svcControlMemory(&dummy, prefetch->shared.text_addr, 0, prefetch->shared.total_size << 12, MEMOP_FREE, 0);
     }
   }
+  // on failure nothing is held and LoadProcess does the work itself
+  prefetch->res = res;
+}
 
-  // get kernel flags
-  flags = 0;
-  for (count = 0; count < 28; count++)
+// closes .code and frees the memory of a prefetch that went through
+static void prefetch_release(prefetch_t *prefetch)
+{
+  u32 dummy;
+
+  IFile_Close(&prefetch->file);
+  svcControlMemory(&dummy, prefetch->shared.text_addr, 0, prefetch->shared.total_size << 12, MEMOP_FREE, 0);
+}
+
+static void prefetch_wait_exheader(void)
+{
+  if (g_prefetch_running)
   {
-    desc = g_exheader.arm11kernelcaps.descriptors[count];
-    if (0x1FE == desc >> 23)
-    {
-      flags = desc & 0xF00;
-    }
+    svcWaitSynchronization(g_prefetch.exheader_done, U64_MAX);
   }
-  if (flags == 0)
+}
+
+static void prefetch_join(void)
+{
+  if (g_prefetch_running)
   {
-    return MAKERESULT(RL_PERMANENT, RS_INVALIDARG, 1, 2);
+    worker_join(&g_prefetch_worker);
+    g_prefetch_running = 0;
   }
+}
 
-  // allocate process memory
-  vaddr.text_addr = g_exheader.codesetinfo.text.address;
-  vaddr.text_size = (g_exheader.codesetinfo.text.codesize + 4095) >> 12;
-  vaddr.ro_addr = g_exheader.codesetinfo.ro.address;
-  vaddr.ro_size = (g_exheader.codesetinfo.ro.codesize + 4095) >> 12;
-  vaddr.data_addr = g_exheader.codesetinfo.data.address;
-  vaddr.data_size = (g_exheader.codesetinfo.data.codesize + 4095) >> 12;
-  data_mem_size = (g_exheader.codesetinfo.data.codesize + g_exheader.codesetinfo.bsssize + 4095) >> 12;
-  vaddr.total_size = vaddr.text_size + vaddr.ro_size + vaddr.data_size;
-  if ((res = allocate_shared_mem(&shared_addr, &vaddr, flags)) < 0)
+static void prefetch_drop(void)
+{
+  prefetch_join();
+  if (g_prefetch.prog_handle != 0 && R_SUCCEEDED(g_prefetch.res))
+  {
+    prefetch_release(&g_prefetch);
+  }
+  g_prefetch.prog_handle = 0;
+}
+
+// waits for the prefetch and moves it to prefetch if it is for prog_handle,
+// returns 0 and drops it otherwise
+static int prefetch_take(u64 prog_handle, prefetch_t *prefetch)
+{
+  prefetch_join();
+  if (g_prefetch.prog_handle == prog_handle && R_SUCCEEDED(g_prefetch.res))
+  {
+    *prefetch = g_prefetch;
+    g_prefetch.prog_handle = 0;
+    return 1;
+  }
+  prefetch_drop();
+  return 0;
+}
+
+static void prefetch_start(u64 prog_handle)
+{
+  if (!PREFETCH_ENABLE)
+  {
+    return;
+  }
+  prefetch_drop();
+  if (g_prefetch.exheader_done == 0 &&
+      R_FAILED(svcCreateEvent(&g_prefetch.exheader_done, RESET_STICKY)))
   {
+    g_prefetch.exheader_done = 0;
+    return;
+  }
+  svcClearEvent(g_prefetch.exheader_done);
+  g_prefetch.prog_handle = prog_handle;
+  g_prefetch.res = -1;
+  // below the command loop so replies to pm go out first
+  if (R_FAILED(worker_start(&g_prefetch_worker, prefetch_main, &g_prefetch, 
+        g_prefetch_stack, sizeof(g_prefetch_stack), 
+        worker_current_priority() + 1, -2)))
+  {
+    g_prefetch.prog_handle = 0;
+    return;
+  }
+  g_prefetch_running = 1;
+}
+
+// the shared state a load needs, done with the lock held when a worker loads
+static Result load_prepare(load_job *job)
+{
+  exheader_header *exheader;
+  Result res;
+  u32 flags;
+  u64 start;
+
+  // whatever the prefetch has not read by now is waited for here
+  start = profile_tick();
+  job->prefetched = prefetch_take(job->prog_handle, &job->prefetch);
+  profile_add(PROFILE_READ, start);
+
+  start = profile_tick();
+  res = get_exheader(&exheader, job->prog_handle);
+  profile_add(PROFILE_EXHEADER, start);
+  if (res >= 0)
+  {
+    memcpy(&job->exheader, exheader, sizeof(exheader_header));
+    res = get_layout(&job->exheader, &job->vaddr, &flags, &job->data_mem_size);
+  }
+  if (res < 0)
+  {
+    if (job->prefetched)
+    {
+      prefetch_release(&job->prefetch);
+    }
     return res;
   }
+  job->progid = job->exheader.arm11systemlocalcaps.programid;
+  fsprio_begin(job->progid, flags);
+
+  // allocate process memory
+  if (job->prefetched)
+  {
+    job->shared = job->prefetch.shared;
+    return 0;
+  }
+  return allocate_shared_mem(&job->shared, &job->vaddr, flags);
+}
+
+static Result load_run(load_job *job, Handle *process)
+{
+  Result res;
+  u32 dummy;
+  Handle codeset;
+  CodeSetInfo codesetinfo;
+  u64 start;
 
   // load code
-  progid = g_exheader.arm11systemlocalcaps.programid;
-  if ((res = load_code(progid, &shared_addr, prog_handle, g_exheader.codesetinfo.flags.flag & 1)) >= 0)
-  {
-    memcpy(&codesetinfo.name, g_exheader.codesetinfo.name, 8);
-    codesetinfo.program_id = progid;
-    codesetinfo.text_addr = vaddr.text_addr;
-    codesetinfo.text_size = vaddr.text_size;
-    codesetinfo.text_size_total = vaddr.text_size;
-    codesetinfo.ro_addr = vaddr.ro_addr;
-    codesetinfo.ro_size = vaddr.ro_size;
-    codesetinfo.ro_size_total = vaddr.ro_size;
-    codesetinfo.rw_addr = vaddr.data_addr;
-    codesetinfo.rw_size = vaddr.data_size;
-    codesetinfo.rw_size_total = data_mem_size;
-    res = svcCreateCodeSet(&codeset, &codesetinfo, (void *)shared_addr.text_addr, (void *)shared_addr.ro_addr, (void *)shared_addr.data_addr);
+  if ((res = load_code(job->progid, &job->exheader, &job->shared, job->prog_handle, job->exheader.codesetinfo.flags.flag & 1, job->prefetched ? &job->prefetch : NULL)) >= 0)
+  {
+    memcpy(&codesetinfo.name, job->exheader.codesetinfo.name, 8);
+    codesetinfo.program_id = job->progid;
+    codesetinfo.text_addr = job->vaddr.text_addr;
+    codesetinfo.text_size = job->vaddr.text_size;
+    codesetinfo.text_size_total = job->vaddr.text_size;
+    codesetinfo.ro_addr = job->vaddr.ro_addr;
+    codesetinfo.ro_size = job->vaddr.ro_size;
+    codesetinfo.ro_size_total = job->vaddr.ro_size;
+    codesetinfo.rw_addr = job->vaddr.data_addr;
+    codesetinfo.rw_size = job->vaddr.data_size;
+    codesetinfo.rw_size_total = job->data_mem_size;
+    start = profile_tick();
+    res = svcCreateCodeSet(&codeset, &codesetinfo, (void *)job->shared.text_addr, (void *)job->shared.ro_addr, (void *)job->shared.data_addr);
+    profile_add(PROFILE_CODESET, start);
     if (res >= 0)
     {
-      res = svcCreateProcess(process, codeset, g_exheader.arm11kernelcaps.descriptors, count);
+      start = profile_tick();
+      res = svcCreateProcess(process, codeset, job->exheader.arm11kernelcaps.descriptors, 28);
+      profile_add(PROFILE_PROCESS, start);
       svcCloseHandle(codeset);
       if (res >= 0)
       {
@@ -269,15 +510,132 @@ static Result loader_LoadProcess(Handle *process, u64 prog_handle)
     }
   }
 
-  svcControlMemory(&dummy, shared_addr.text_addr, 0, shared_addr.total_size << 12, MEMOP_FREE, 0);
+  svcControlMemory(&dummy, job->shared.text_addr, 0, job->shared.total_size << 12, MEMOP_FREE, 0);
+  return res;
+}
+
+static Result loader_LoadProcess(Handle *process, u64 prog_handle)
+{
+  Result res;
+
+  g_load_job.prog_handle = prog_handle;
+  g_load_job.progid = 0;
+  profile_begin();
+  res = load_prepare(&g_load_job);
+  if (res >= 0)
+  {
+    res = load_run(&g_load_job, process);
+  }
+  fsprio_end();
+  profile_end(g_load_job.progid, res);
   return res;
 }
 
-static Result loader_RegisterProgram(u64 *prog_handle, FS_ProgramInfo *title, FS_ProgramInfo *update)
+// LoadProcess on the worker, which replies to pm itself
+static void load_main(void *arg)
+{
+  load_job *job;
+  Handle process;
+  u32 *cmdbuf;
+  s32 index;
+  Result res;
+  int taken;
+
+  job = (load_job *)arg;
+  process = 0;
+  job->progid = 0;
+  profile_begin();
+  state_lock();
+  res = load_prepare(job);
+  state_unlock();
+  if (res >= 0)
+  {
+    res = load_run(job, &process);
+  }
+  fsprio_end();
+
+  cmdbuf = getThreadCommandBuffer();
+  cmdbuf[0] = 0x10042;
+  cmdbuf[1] = res;
+  cmdbuf[2] = 16;
+  cmdbuf[3] = process;
+
+  state_lock();
+  profile_end(job->progid, res);
+  trace_reply(job->trace, cmdbuf);
+  cmdstats_end(cmdbuf[0], job->received);
+  taken = trace_take();
+  state_unlock();
+
+  // with no handles to wait on the kernel only delivers the reply and
+  // returns, it fails if pm closed the session meanwhile and then the
+  // process handle never reached it
+  if (R_FAILED(svcReplyAndReceive(&index, NULL, 0, job->session)) && process != 0)
+  {
+    svcCloseHandle(process);
+  }
+
+  state_lock();
+  if (job->closed)
+  {
+    svcCloseHandle(job->session);
+  }
+  job->session = 0;
+  state_unlock();
+
+  if (taken)
+  {
+    write_trace();
+  }
+}
+
+static void load_join(void)
+{
+  if (g_load_running)
+  {
+    worker_join(&g_load_worker);
+    g_load_running = 0;
+  }
+}
+
+// hands a LoadProcess request on session to the worker, returns 0 for any
+// other request or if the worker could not be started
+static int load_dispatch(Handle session, u32 trace, u64 received)
+{
+  u32 *cmdbuf;
+
+  cmdbuf = getThreadCommandBuffer();
+  if (!LOAD_WORKER_ENABLE || cmdbuf[0] >> 16 != 1)
+  {
+    return 0;
+  }
+  // loads use the same process memory, one at a time
+  load_join();
+  g_load_job.prog_handle = *(u64 *)&cmdbuf[1];
+  g_load_job.session = session;
+  g_load_job.closed = 0;
+  g_load_job.trace = trace;
+  g_load_job.received = received;
+  if (R_FAILED(worker_start(&g_load_worker, load_main, &g_load_job, 
+        g_load_stack, sizeof(g_load_stack), 
+        worker_current_priority() + 1, LOAD_WORKER_CORE)))
+  {
+    g_load_job.session = 0;
+    return 0;
+  }
+  g_load_running = 1;
+  return 1;
+}
+
+// a program pm registers on NAND may have been registered as a dependency
+// already, the warm-up did it the same way so its handle stands in for a new
+// one and its exheader comes along in warm
+static Result loader_RegisterProgram(u64 *prog_handle, const exheader_header **warm, FS_ProgramInfo *title, FS_ProgramInfo *update)
 {
   Result res;
   u64 prog_id;
 
+  *warm = NULL;
   prog_id = title->programId;
   if (prog_id >> 32 != 0xFFFF0000)
   {
@@ -307,7 +665,15 @@ static Result loader_RegisterProgram(u64 *prog_handle, FS_ProgramInfo *title, FS
   {
     svcBreak(USERBREAK_ASSERT);
   }
-  res = FSREG_LoadProgram(prog_handle, title);
+  res = 0;
+  if (title->mediaType == MEDIATYPE_NAND)
+  {
+    *prog_handle = warmup_claim(prog_id, warm);
+  }
+  if (*warm == NULL)
+  {
+    res = FSREG_LoadProgram(prog_handle, title);
+  }
   if (R_SUCCEEDED(res))
   {
     if (*prog_handle >> 32 == 0xFFFF0000)
@@ -347,6 +713,7 @@ static Result loader_UnregisterProgram(u64 prog_handle)
   }
 }
 
+// called with the state lock held, the SD dumps drop it
 static void handle_commands(void)
 {
   FS_ProgramInfo title;
@@ -356,6 +723,9 @@ static void handle_commands(void)
   int res;
   Handle handle;
   u64 prog_handle;
+  const exheader_header *warm;
+  exheader_header *exheader;
+  u32 count;
 
   cmdbuf = getThreadCommandBuffer();
   cmdid = cmdbuf[0] >> 16;
@@ -375,7 +745,17 @@ static void handle_commands(void)
     {
       memcpy(&title, &cmdbuf[1], sizeof(FS_ProgramInfo));
       memcpy(&update, &cmdbuf[5], sizeof(FS_ProgramInfo));
-      res = loader_RegisterProgram(&prog_handle, &title, &update);
+      res = loader_RegisterProgram(&prog_handle, &warm, &title, &update);
+      if (R_SUCCEEDED(res))
+      {
+        warmup_registered(prog_handle, title.programId);
+        prefetch_wait_exheader();
+        if (warm != NULL)
+        {
+          memcpy(exhcache_insert(prog_handle), warm, sizeof(exheader_header));
+        }
+        prefetch_start(prog_handle);
+      }
       cmdbuf[0] = 0x200C0;
       cmdbuf[1] = res;
       *(u64 *)&cmdbuf[2] = prog_handle;
@@ -383,36 +763,91 @@ static void handle_commands(void)
     }
     case 3: // UnregisterProgram
     {
-      if (g_cached_prog_handle == prog_handle)
+      prog_handle = *(u64 *)&cmdbuf[1];
+      prefetch_wait_exheader();
+      if (g_prefetch.prog_handle == prog_handle)
       {
-        g_cached_prog_handle = 0;
+        prefetch_drop();
       }
+      exhcache_drop(prog_handle);
+      warmup_unregistered(prog_handle);
       cmdbuf[0] = 0x30040;
-      cmdbuf[1] = loader_UnregisterProgram(*(u64 *)&cmdbuf[1]);
+      cmdbuf[1] = loader_UnregisterProgram(prog_handle);
       break;
     }
     case 4: // GetProgramInfo
     {
       prog_handle = *(u64 *)&cmdbuf[1];
-      if (prog_handle != g_cached_prog_handle)
+      prefetch_wait_exheader();
+      res = get_exheader(&exheader, prog_handle);
+      if (res >= 0)
       {
-        res = loader_GetProgramInfo(&g_exheader, prog_handle);
-        if (res >= 0)
-        {
-          g_cached_prog_handle = prog_handle;
-        }
-        else
-        {
-          g_cached_prog_handle = 0;
-        }
+        memcpy(&g_ret_buf, exheader, 1024);
+        // pm launches the dependencies next
+        warmup_start(exheader);
       }
-      memcpy(&g_ret_buf, &g_exheader, 1024);
       cmdbuf[0] = 0x40042;
       cmdbuf[1] = res;
       cmdbuf[2] = 0x1000002;
       cmdbuf[3] = (u32) &g_ret_buf;
       break;
     }
+    case 0x100: // GetLoadProfile
+    {
+      count = profile_read((profile_record *)g_ret_buf, sizeof(g_ret_buf) / sizeof(profile_record));
+      if (cmdbuf[1] & PROFILE_DUMP_SD)
+      {
+        // the copy in g_ret_buf is the command thread's
+        state_unlock();
+        res = profile_dump((profile_record *)g_ret_buf, count);
+        state_lock();
+        trace_flush();
+      }
+      if (cmdbuf[1] & PROFILE_CLEAR)
+      {
+        profile_clear();
+      }
+      cmdbuf[0] = 0x1000082;
+      cmdbuf[1] = res;
+      cmdbuf[2] = count;
+      cmdbuf[3] = ((count * sizeof(profile_record)) << 14) | 2;
+      cmdbuf[4] = (u32) &g_ret_buf;
+      break;
+    }
+    case 0x101: // GetExheaderCacheStats
+    {
+      cmdbuf[0] = 0x10100C0;
+      cmdbuf[1] = 0;
+      exhcache_stats(&cmdbuf[2], &cmdbuf[3]);
+      break;
+    }
+    case 0x102: // GetPatchStats
+    {
+      cmdbuf[0] = 0x10200C0;
+      cmdbuf[1] = 0;
+      patch_stats(&cmdbuf[2], &cmdbuf[3]);
+      break;
+    }
+    case 0x103: // GetCommandStats
+    {
+      count = cmdstats_read((cmdstats_entry *)g_ret_buf, sizeof(g_ret_buf) / sizeof(cmdstats_entry));
+      if (cmdbuf[1] & CMDSTATS_DUMP_SD)
+      {
+        state_unlock();
+        res = cmdstats_dump((cmdstats_entry *)g_ret_buf, count);
+        state_lock();
+      }
+      if (cmdbuf[1] & CMDSTATS_CLEAR)
+      {
+        cmdstats_clear();
+      }
+      cmdbuf[0] = 0x1030082;
+      cmdbuf[1] = res;
+      cmdbuf[2] = count;
+      cmdbuf[3] = ((count * sizeof(cmdstats_entry)) << 14) | 2;
+      cmdbuf[4] = (u32) &g_ret_buf;
+      break;
+    }
     default: // error
     {
       cmdbuf[0] = 0x40;
@@ -487,6 +922,10 @@ int main()
   int i;
   int term_request;
   u32* cmdbuf;
+  u32 header;
+  u32 trace;
+  u64 received;
+  int taken;
 
   ret = 0;
   srv_handle = &g_handles[1];
@@ -502,8 +941,15 @@ int main()
     svcBreak(USERBREAK_ASSERT);
   }
 
+  if (LOAD_WORKER_ENABLE && R_FAILED(svcCreateMutex(&g_lock, false)))
+  {
+    svcBreak(USERBREAK_ASSERT);
+  }
+
+  // SD patches are retried at launch if SD is not up yet
+  patch_init();
+
   g_active_handles = 2;
-  g_cached_prog_handle = 0;
   index = 1;
 
   reply_target = 0;
@@ -533,7 +979,17 @@ int main()
             }
           }
         }
-        svcCloseHandle(g_handles[index]);
+        // a session the worker still has to reply to is closed by it
+        state_lock();
+        if (g_handles[index] == g_load_job.session)
+        {
+          g_load_job.closed = 1;
+        }
+        else
+        {
+          svcCloseHandle(g_handles[index]);
+        }
+        state_unlock();
         g_handles[index] = g_handles[g_active_handles-1];
         g_active_handles--;
         reply_target = 0;
@@ -576,7 +1032,26 @@ int main()
         }
         default: // session
         {
+          cmdbuf = getThreadCommandBuffer();
+          header = cmdbuf[0];
+          state_lock();
+          received = cmdstats_begin();
+          trace = trace_request(cmdbuf);
+          state_unlock();
+          if (load_dispatch(g_handles[index], trace, received))
+          {
+            break;
+          }
+          state_lock();
           handle_commands();
+          trace_reply(trace, cmdbuf);
+          cmdstats_end(header, received);
+          taken = trace_take();
+          state_unlock();
+          if (taken)
+          {
+            write_trace();
+          }
           reply_target = g_handles[index];
           break;
         }
@@ -584,6 +1059,18 @@ int main()
     }
   } while (!term_request || g_active_handles != 2);
 
+  load_join();
+  warmup_stop();
+  // the half set aside before, if its write failed, then the one in use
+  do
+  {
+    trace_flush();
+  } while (trace_take() && R_SUCCEEDED(write_trace()));
+  if (LOAD_WORKER_ENABLE)
+  {
+    svcCloseHandle(g_lock);
+  }
+
   srvSysUnregisterService("Loader");
   svcCloseHandle(*srv_handle);
   svcCloseHandle(*notification_handle);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// where the segments of a program are, sizes are in pages
+typedef struct
+{
+  u32 text_addr;
+  u32 text_size;
+  u32 ro_addr;
+  u32 ro_size;
+  u32 data_addr;
+  u32 data_size;
+  u32 total_size;
+} prog_addrs_t;
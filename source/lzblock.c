@@ -0,0 +1,92 @@
+#include <3ds/types.h>
+#include <string.h>
+#include "lzblock.h"
+#include "lzss.h"
+
+// Block images split the decoded code into blocks of block_size bytes, each
+// packed as its own backwards LZSS stream (see lzss.c) or stored as is:
+//   the stored blocks, first to last, back to back
+//   u32 stored size of each block, LZBLOCK_RAW set if it is not compressed
+//   lzblock_footer
+// The footer's magic takes the place of the size increase of a plain image,
+// which is never that large.
+//
+// A stream decodes in place when it starts where its block does, so the
+// blocks are first moved up to their block's offset, last block first. No
+// stored block lies above its block's offset, so the moves never overwrite
+// a block not moved yet, and decoding a block only writes between its own
+// offset and the next block's.
+
+static u32 block_out_size(const lzblock_index *index, u32 block)
+{
+  if (block + 1 < index->count)
+  {
+    return index->block_size;
+  }
+  return index->image_size - block * index->block_size;
+}
+
+int lzblock_read_index(lzblock_index *index, const u8 *code, u32 size)
+{
+  lzblock_footer footer;
+  u32 stored;
+  u32 len;
+  u32 i;
+
+  if (size < sizeof(footer))
+  {
+    return 0;
+  }
+  memcpy(&footer, code + size - sizeof(footer), sizeof(footer));
+  if (footer.magic != LZBLOCK_MAGIC || footer.count == 0 || footer.count > LZBLOCK_MAX ||
+      footer.block_size == 0 || (footer.block_size & 3) != 0 ||
+      footer.image_size <= (footer.count - 1) * footer.block_size ||
+      footer.image_size > footer.count * footer.block_size ||
+      size - sizeof(footer) < footer.count * 4)
+  {
+    return 0;
+  }
+  index->count = footer.count;
+  index->block_size = footer.block_size;
+  index->image_size = footer.image_size;
+  memcpy(index->sizes, code + size - sizeof(footer) - footer.count * 4, footer.count * 4);
+
+  stored = 0;
+  for (i = 0; i < index->count; i++)
+  {
+    len = index->sizes[i] & ~LZBLOCK_RAW;
+    if ((index->sizes[i] & LZBLOCK_RAW) ? len != block_out_size(index, i) : len > block_out_size(index, i))
+    {
+      return 0;
+    }
+    stored += len;
+  }
+  return stored == size - sizeof(footer) - footer.count * 4;
+}
+
+void lzblock_place(const lzblock_index *index, u8 *code)
+{
+  u32 offset;
+  u32 len;
+  u32 i;
+
+  offset = 0;
+  for (i = 0; i < index->count; i++)
+  {
+    offset += index->sizes[i] & ~LZBLOCK_RAW;
+  }
+  for (i = index->count; i-- > 0;)
+  {
+    len = index->sizes[i] & ~LZBLOCK_RAW;
+    offset -= len;
+    memmove(code + i * index->block_size, code + offset, len);
+  }
+}
+
+void lzblock_decode(const lzblock_index *index, u8 *code, u32 block)
+{
+  if (!(index->sizes[block] & LZBLOCK_RAW))
+  {
+    lzss_decompress(code + block * index->block_size + index->sizes[block]);
+  }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <3ds/types.h>
+
+#define LZBLOCK_MAGIC 0x4B4C425A // "ZBLK"
+#define LZBLOCK_MAX 64
+#define LZBLOCK_RAW 0x80000000   // in a block size, the block is stored as is
+
+// last bytes of a block image, after the stored size of every block
+typedef struct
+{
+  u32 image_size; // decoded bytes
+  u32 block_size; // decoded bytes per block, the last block may be shorter
+  u32 count;
+  u32 magic;
+} lzblock_footer;
+
+typedef struct
+{
+  u32 count;
+  u32 block_size;
+  u32 image_size;
+  u32 sizes[LZBLOCK_MAX];
+} lzblock_index;
+
+// copies the index of the block image in the first size bytes of code,
+// returns 0 if it is not one
+int lzblock_read_index(lzblock_index *index, const u8 *code, u32 size);
+// moves every block to where it decodes, the index is gone afterwards
+void lzblock_place(const lzblock_index *index, u8 *code);
+// decodes one placed block, blocks are independent of each other
+void lzblock_decode(const lzblock_index *index, u8 *code, u32 block);
@@ -0,0 +1,184 @@
+#include <3ds/types.h>
+#include <string.h>
+#include "lzss.h"
+
+// Stream layout, read from `end` downwards:
+//   end-4: size increase of the decompressed image
+//   end-8: header length in the top byte, compressed length in the low 24 bits
+// Each flag byte describes the next 8 tokens, MSB first. A clear bit is one
+// literal byte, a set bit is a 2 byte back-reference: 4 bits length - 3 and
+// 12 bits distance - 3, the source lying above the write pointer.
+
+void lzss_begin(lzss_state *state, u8 *end)
+{
+  u32 info;
+
+  info = *((u32 *)end - 2);
+  state->out = end + *((u32 *)end - 1);
+  state->in = end - (info >> 24);
+  state->stop = end - (info & 0xFFFFFF);
+}
+
+int lzss_continue(lzss_state *state, const u8 *avail)
+{
+  u8 *out;
+  u8 *in;
+  u8 *stop;
+  const u8 *limit;
+  u32 flags;
+  u32 bits;
+  u32 len;
+  u32 dist;
+  u32 word[2];
+
+  out = state->out;
+  in = state->in;
+  stop = state->stop;
+  // only start a group when all of its bytes are guaranteed to be loaded
+  if (avail == NULL || avail <= stop)
+  {
+    limit = stop;
+  }
+  else
+  {
+    limit = avail + LZSS_GROUP_MAX;
+  }
+  while (in > stop)
+  {
+    if (in < limit)
+    {
+      state->out = out;
+      state->in = in;
+      return 0;
+    }
+    flags = *--in;
+    // a clear flag byte is a run of 8 literals, copy it as two words when
+    // the run does not overlap the bytes it is written over
+    if (flags == 0 && in - stop >= 8 && out - in >= 8)
+    {
+      in -= 8;
+      out -= 8;
+      memcpy(word, in, 8);
+      memcpy(out, word, 8);
+      continue;
+    }
+    for (bits = 8; bits > 0; bits--)
+    {
+      if (flags & 0x80)
+      {
+        len = (in[-1] >> 4) + 3;
+        dist = (((in[-1] & 0xF) << 8) | in[-2]) + 3;
+        in -= 2;
+        // with dist >= 4 every source word is already final
+        if (dist >= 4)
+        {
+          while (len >= 4)
+          {
+            out -= 4;
+            memcpy(word, out + dist, 4);
+            memcpy(out, word, 4);
+            len -= 4;
+          }
+        }
+        while (len > 0)
+        {
+          out--;
+          *out = out[dist];
+          len--;
+        }
+      }
+      else
+      {
+        *--out = *--in;
+      }
+      flags <<= 1;
+      if (in <= stop)
+      {
+        break;
+      }
+    }
+  }
+  state->out = out;
+  state->in = in;
+  return 1;
+}
+
+int lzss_decompress(u8 *end)
+{
+  lzss_state state;
+
+  if (end == NULL)
+  {
+    return 0;
+  }
+  lzss_begin(&state, end);
+  lzss_continue(&state, NULL);
+  return 0;
+}
+
+// original byte-at-a-time decoder, kept as the reference for lzss_decompress
+int lzss_decompress_bytewise(u8 *end)
+{
+  unsigned int v1; // r1@2
+  u8 *v2; // r2@2
+  u8 *v3; // r3@2
+  u8 *v4; // r1@2
+  char v5; // r5@4
+  char v6; // t1@4
+  signed int v7; // r6@4
+  int v9; // t1@7
+  u8 *v11; // r3@8
+  int v12; // r12@8
+  int v13; // t1@8
+  int v14; // t1@8
+  unsigned int v15; // r7@8
+  int v16; // r12@8
+  int ret;
+
+  ret = 0;
+  if ( end )
+  {
+    v1 = *((u32 *)end - 2);
+    v2 = &end[*((u32 *)end - 1)];
+    v3 = end - (v1 >> 24);
+    v4 = end - (v1 & 0xFFFFFF);
+    while ( v3 > v4 )
+    {
+      v6 = *(v3-- - 1);
+      v5 = v6;
+      v7 = 8;
+      while ( 1 )
+      {
+        if ( (v7-- < 1) )
+          break;
+        if ( v5 & 0x80 )
+        {
+          v13 = *(v3 - 1);
+          v11 = v3 - 1;
+          v12 = v13;
+          v14 = *(v11 - 1);
+          v3 = v11 - 1;
+          v15 = ((v14 | (v12 << 8)) & 0xFFFF0FFF) + 2;
+          v16 = v12 + 32;
+          do
+          {
+            ret = v2[v15];
+            *(v2-- - 1) = ret;
+            v16 -= 16;
+          }
+          while ( !(v16 < 0) );
+        }
+        else
+        {
+          v9 = *(v3-- - 1);
+          ret = v9;
+          *(v2-- - 1) = v9;
+        }
+        v5 *= 2;
+        if ( v3 <= v4 )
+          return ret;
+      }
+    }
+  }
+  return ret;
+}
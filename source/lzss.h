@@ -0,0 +1,23 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// most compressed bytes one flag byte and its 8 tokens can consume
+#define LZSS_GROUP_MAX 17
+
+typedef struct
+{
+  u8 *out;
+  u8 *in;
+  u8 *stop;
+} lzss_state;
+
+// decompresses a backwards LZSS image in place, `end` points past the footer
+int lzss_decompress(u8 *end);
+int lzss_decompress_bytewise(u8 *end);
+
+// incremental decoding while the image is still being loaded from its end:
+// lzss_continue decodes as far as the bytes from `avail` up allow and returns
+// 1 once the image is complete, a NULL `avail` means everything is loaded
+void lzss_begin(lzss_state *state, u8 *end);
+int lzss_continue(lzss_state *state, const u8 *avail);
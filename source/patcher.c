@@ -1,197 +1,429 @@
 #include <3ds.h>
 #include <string.h>
 #include "patcher.h"
+#include "hash.h"
 #include "ifile.h"
+#include "patchfile.h"
+#include "patchsites.h"
+#include "patch_tables.h"
+#include "worker.h"
 
-#ifndef PATH_MAX
-#define PATH_MAX 255
+// bump whenever patches.def changes so cached patched code is rebuilt
+#define PATCH_SET_VERSION 3
+
+// Segments of PATCH_PARALLEL_MIN bytes or more are searched in two halves,
+// the upper one on a helper thread on PATCH_PARALLEL_CORE.
+#ifndef PATCH_PARALLEL_ENABLE
+#define PATCH_PARALLEL_ENABLE 0
+#endif
+
+#ifndef PATCH_PARALLEL_MIN
+#define PATCH_PARALLEL_MIN 0x100000
+#endif
+
+#ifndef PATCH_PARALLEL_CORE
+#define PATCH_PARALLEL_CORE 0
+#endif
+
+#define SCANNER_STACK_SIZE 0x1000
+
+// With PATCH_FUSED_ENABLE=1 compressed code is searched while it is decoded,
+// see patch_scan_final.
+#ifndef PATCH_FUSED_ENABLE
+#define PATCH_FUSED_ENABLE 0
 #endif
 
+#define FUSED_KEEP (2 * PATCH_HITS)
+
+// bits of the filter of titles that have patches, two per title
+#define PATCH_FILTER_BITS 2048
+
+typedef struct
+{
+  u8 *start;
+  u32 size;
+  const patch_set *set;
+  const patch_scan *scan;
+  u8 *hits[PATCH_MAX][PATCH_HITS];
+  int found[PATCH_MAX];
+} scan_job;
+
+typedef struct
+{
+  const patch_set *set; // NULL unless a search is running
+  u64 progid;
+  u8 *start[PATCH_SEGMENTS];
+  u32 size[PATCH_SEGMENTS];
+  u8 *done;             // searched from here up
+  u8 *kept[PATCH_MAX][FUSED_KEEP]; // the lowest matches, ascending
+  int nkept[PATCH_MAX];
+  int dropped[PATCH_MAX]; // higher matches that did not fit
+} fused_scan;
+
+static scan_job g_upper;
+static fused_scan g_fused;
+static worker_t g_scanner;
+static u8 g_scanner_stack[SCANNER_STACK_SIZE] ALIGN(8);
+
 static char secureinfo[0x111] = {0};
 
-// Below is stolen from http://en.wikipedia.org/wiki/Boyer%E2%80%93Moore_string_search_algorithm
-
-#define ALPHABET_LEN 256
-#define NOT_FOUND patlen
-#define max(a, b) ((a < b) ? b : a)
- 
-// delta1 table: delta1[c] contains the distance between the last
-// character of pat and the rightmost occurence of c in pat.
-// If c does not occur in pat, then delta1[c] = patlen.
-// If c is at string[i] and c != pat[patlen-1], we can
-// safely shift i over by delta1[c], which is the minimum distance
-// needed to shift pat forward to get string[i] lined up 
-// with some character in pat.
-// this algorithm runs in alphabet_len+patlen time.
-static void make_delta1(int *delta1, u8 *pat, int patlen)
+typedef struct
+{
+  u64 progid;
+  const patch_set *set;
+} builtin_t;
+
+static const builtin_t g_builtin[] =
 {
+  { 0x0004003000008F02LL, &patch_set_menu }, // USA Menu
+  { 0x0004003000008202LL, &patch_set_menu }, // JPN Menu
+  { 0x0004003000009802LL, &patch_set_menu }, // EUR Menu
+  { 0x000400300000A102LL, &patch_set_menu }, // CHN Menu
+  { 0x000400300000A902LL, &patch_set_menu }, // KOR Menu
+  { 0x000400300000B102LL, &patch_set_menu }, // TWN Menu
+  { 0x0004013000002C02LL, &patch_set_nim },  // NIM
+  { 0x0004013000008002LL, &patch_set_ns },   // NS
+  { 0x0004013000001702LL, &patch_set_cfg },  // CFG
+};
+
+static u32 g_filter[PATCH_FILTER_BITS / 32];
+static int g_filter_complete; // has the titles of the SD file too
+static u32 g_launches;
+static u32 g_skipped;
+
+// Finds the first count non-overlapping matches of the patches of one segment
+// that start below limit. This is Horspool's search run on a window as long
+// as the shortest of their patterns: the byte ending the window picks the
+// patches worth checking there and how far the window can move.
+static void find_patches(u8 *start, u32 size, u32 limit, const patch_set *set, const patch_scan *scan, u8 *hits[][PATCH_HITS], int *found)
+{
+  const patch_t *patch;
+  u32 from[PATCH_MAX];
+  u32 pos;
+  u32 at;
+  u32 pending;
   int i;
-  for (i=0; i < ALPHABET_LEN; i++) {
-    delta1[i] = NOT_FOUND;
-  }
-  for (i=0; i < patlen-1; i++) {
-    delta1[pat[i]] = patlen-1 - i;
+
+  memset(from, 0, sizeof(from));
+  pending = scan->n;
+  for (pos = scan->winlen - 1; pos < size && pending > 0; pos += scan->shift[start[pos]])
+  {
+    at = pos - (scan->winlen - 1);
+    for (i = scan->head[start[pos]]; i != NO_PATCH; i = set->next[i])
+    {
+      patch = &set->patches[i];
+      if (found[i] < patch->count && at >= from[i] && at < limit && patch->patsize <= size - at &&
+          memcmp(start + at, patch->pattern, patch->patsize) == 0)
+      {
+        hits[i][found[i]++] = start + at;
+        from[i] = at + patch->patsize;
+        if (found[i] == patch->count)
+        {
+          pending--;
+        }
+      }
+    }
   }
 }
- 
-// true if the suffix of word starting from word[pos] is a prefix 
-// of word
-static int is_prefix(u8 *word, int wordlen, int pos)
+
+static void scanner_main(void *arg)
+{
+  scan_job *job;
+
+  job = (scan_job *)arg;
+  memset(job->found, 0, sizeof(job->found));
+  find_patches(job->start, job->size, job->size, job->set, job->scan, job->hits, job->found);
+}
+
+// The lower half runs on past the middle by the longest pattern less one so
+// it sees every match starting below it, the upper half takes the matches
+// from the middle on. Per patch, the upper half's matches follow the lower
+// half's, as a single search would have found them, unless its first one
+// overlaps the last match below the middle. Then the segment is searched
+// again on one thread.
+static void find_patches_parallel(u8 *start, u32 size, const patch_set *set, const patch_scan *scan, u8 *hits[][PATCH_HITS], int *found)
 {
+  u8 *lower_hits[PATCH_MAX][PATCH_HITS];
+  int lower_found[PATCH_MAX];
+  const patch_t *patch;
+  u32 mid;
+  u32 end;
   int i;
-  int suffixlen = wordlen - pos;
-  // could also use the strncmp() library function here
-  for (i = 0; i < suffixlen; i++) {
-    if (word[i] != word[pos+i]) {
-      return 0;
+  int k;
+
+  mid = size / 2;
+  end = mid + scan->maxlen - 1;
+  g_upper.start = start + mid;
+  g_upper.size = size - mid;
+  g_upper.set = set;
+  g_upper.scan = scan;
+  if (!PATCH_PARALLEL_ENABLE || size < PATCH_PARALLEL_MIN || end >= size ||
+      R_FAILED(worker_start(&g_scanner, scanner_main, &g_upper, 
+        g_scanner_stack, sizeof(g_scanner_stack), 
+        worker_current_priority(), PATCH_PARALLEL_CORE)))
+  {
+    find_patches(start, size, size, set, scan, hits, found);
+    return;
+  }
+  memset(lower_found, 0, sizeof(lower_found));
+  find_patches(start, end, mid, set, scan, lower_hits, lower_found);
+  worker_join(&g_scanner);
+
+  for (i = 0; i < set->n; i++)
+  {
+    patch = &set->patches[i];
+    if (lower_found[i] > 0 && lower_found[i] < patch->count && g_upper.found[i] > 0 &&
+        g_upper.hits[i][0] < lower_hits[i][lower_found[i] - 1] + patch->patsize)
+    {
+      find_patches(start, size, size, set, scan, hits, found);
+      return;
+    }
+  }
+  for (i = 0; i < set->n; i++)
+  {
+    patch = &set->patches[i];
+    for (k = 0; k < lower_found[i]; k++)
+    {
+      hits[i][found[i]++] = lower_hits[i][k];
+    }
+    for (k = 0; k < g_upper.found[i] && found[i] < patch->count; k++)
+    {
+      hits[i][found[i]++] = g_upper.hits[i][k];
     }
   }
-  return 1;
 }
- 
-// length of the longest suffix of word ending on word[pos].
-// suffix_length("dddbcabc", 8, 4) = 2
-static int suffix_length(u8 *word, int wordlen, int pos)
+
+static void get_segments(const prog_addrs_t *shared, const exheader_codesetinfo *codeset, u8 **start, u32 *size)
 {
-  int i;
-  // increment suffix length i to the first mismatch or beginning
-  // of the word
-  for (i = 0; (word[pos-i] == word[wordlen-1-i]) && (i < pos); i++);
-  return i;
+  start[PATCH_TEXT] = (u8 *)shared->text_addr;
+  size[PATCH_TEXT] = codeset->text.codesize;
+  start[PATCH_RO] = (u8 *)shared->ro_addr;
+  size[PATCH_RO] = codeset->ro.codesize;
+  start[PATCH_DATA] = (u8 *)shared->data_addr;
+  size[PATCH_DATA] = codeset->data.codesize;
+  start[PATCH_ALL] = start[PATCH_TEXT];
+  size[PATCH_ALL] = start[PATCH_DATA] + size[PATCH_DATA] - start[PATCH_TEXT];
 }
- 
-// delta2 table: given a mismatch at pat[pos], we want to align 
-// with the next possible full match could be based on what we
-// know about pat[pos+1] to pat[patlen-1].
-//
-// In case 1:
-// pat[pos+1] to pat[patlen-1] does not occur elsewhere in pat,
-// the next plausible match starts at or after the mismatch.
-// If, within the substring pat[pos+1 .. patlen-1], lies a prefix
-// of pat, the next plausible match is here (if there are multiple
-// prefixes in the substring, pick the longest). Otherwise, the
-// next plausible match starts past the character aligned with 
-// pat[patlen-1].
-// 
-// In case 2:
-// pat[pos+1] to pat[patlen-1] does occur elsewhere in pat. The
-// mismatch tells us that we are not looking at the end of a match.
-// We may, however, be looking at the middle of a match.
-// 
-// The first loop, which takes care of case 1, is analogous to
-// the KMP table, adapted for a 'backwards' scan order with the
-// additional restriction that the substrings it considers as 
-// potential prefixes are all suffixes. In the worst case scenario
-// pat consists of the same letter repeated, so every suffix is
-// a prefix. This loop alone is not sufficient, however:
-// Suppose that pat is "ABYXCDEYX", and text is ".....ABYXCDEYX".
-// We will match X, Y, and find B != E. There is no prefix of pat
-// in the suffix "YX", so the first loop tells us to skip forward
-// by 9 characters.
-// Although superficially similar to the KMP table, the KMP table
-// relies on information about the beginning of the partial match
-// that the BM algorithm does not have.
-//
-// The second loop addresses case 2. Since suffix_length may not be
-// unique, we want to take the minimum value, which will tell us
-// how far away the closest potential match is.
-static void make_delta2(int *delta2, u8 *pat, int patlen)
+
+// records the matches starting in the first limit bytes of start, which lie
+// below every match recorded so far
+static void collect_patches(u8 *start, u32 size, u32 limit, const patch_scan *scan)
 {
-  int p;
-  int last_prefix_index = patlen-1;
- 
-  // first loop
-  for (p=patlen-1; p>=0; p--) {
-    if (is_prefix(pat, patlen, p+1)) {
-      last_prefix_index = p+1;
+  const patch_set *set;
+  const patch_t *patch;
+  u8 *found[PATCH_MAX][FUSED_KEEP];
+  int n[PATCH_MAX];
+  int extra[PATCH_MAX];
+  int keep;
+  u32 pos;
+  u32 at;
+  int i;
+
+  set = g_fused.set;
+  memset(n, 0, sizeof(n));
+  memset(extra, 0, sizeof(extra));
+  for (pos = scan->winlen - 1; pos < size && pos - (scan->winlen - 1) < limit; pos += scan->shift[start[pos]])
+  {
+    at = pos - (scan->winlen - 1);
+    for (i = scan->head[start[pos]]; i != NO_PATCH; i = set->next[i])
+    {
+      patch = &set->patches[i];
+      if (patch->patsize <= size - at && memcmp(start + at, patch->pattern, patch->patsize) == 0)
+      {
+        if (n[i] < FUSED_KEEP)
+        {
+          found[i][n[i]++] = start + at;
+        }
+        else
+        {
+          extra[i]++;
+        }
+      }
     }
-    delta2[p] = last_prefix_index + (patlen-1 - p);
   }
- 
-  // second loop
-  for (p=0; p < patlen-1; p++) {
-    int slen = suffix_length(pat, patlen, p);
-    if (pat[p - slen] != pat[patlen-1 - slen]) {
-      delta2[patlen-1 - slen] = patlen-1 - p + slen;
+
+  for (i = 0; i < set->n; i++)
+  {
+    if (n[i] == 0)
+    {
+      continue;
     }
+    keep = g_fused.nkept[i] < FUSED_KEEP - n[i] ? g_fused.nkept[i] : FUSED_KEEP - n[i];
+    g_fused.dropped[i] += extra[i] + g_fused.nkept[i] - keep;
+    memmove(&g_fused.kept[i][n[i]], &g_fused.kept[i][0], keep * sizeof(u8 *));
+    memcpy(&g_fused.kept[i][0], found[i], n[i] * sizeof(u8 *));
+    g_fused.nkept[i] = n[i] + keep;
   }
 }
- 
-static u8* boyer_moore(u8 *string, int stringlen, u8 *pat, int patlen)
+
+// The decoder writes from the end of the image down, so the image is
+// searched from the top in bands as they become final while they are still
+// in the cache. Taking the first count matches has to wait for the whole
+// image, so the lowest few matches of each patch are kept and patch_code
+// picks from them. Nothing is written before then either, the decoder still
+// copies from the bytes above its write pointer.
+void patch_scan_final(u8 *final)
 {
-  int i;
-  int delta1[ALPHABET_LEN];
-  int delta2[patlen * sizeof(int)];
-  make_delta1(delta1, pat, patlen);
-  make_delta2(delta2, pat, patlen);
- 
-  i = patlen-1;
-  while (i < stringlen) {
-    int j = patlen-1;
-    while (j >= 0 && (string[i] == pat[j])) {
-      --i;
-      --j;
+  const patch_scan *scan;
+  u8 *from;
+  u8 *to;
+  u8 *end;
+  int seg;
+
+  if (g_fused.set == NULL || final >= g_fused.done)
+  {
+    return;
+  }
+  for (seg = 0; seg < PATCH_SEGMENTS; seg++)
+  {
+    scan = g_fused.set->scan[seg];
+    if (scan == NULL)
+    {
+      continue;
     }
-    if (j < 0) {
-      return (string + i+1);
+    end = g_fused.start[seg] + g_fused.size[seg];
+    from = final > g_fused.start[seg] ? final : g_fused.start[seg];
+    to = g_fused.done < end ? g_fused.done : end;
+    if (from < to)
+    {
+      collect_patches(from, end - from, to - from, scan);
     }
- 
-    i += max(delta1[string[i]], delta2[j]);
   }
-  return NULL;
+  g_fused.done = final;
 }
 
-static int patch_memory(start, size, pattern, patsize, offset, replace, repsize, count)
-  u8* start;
-  u32 size;
-  u32 patsize;
-  u8 pattern[patsize];
-  int offset;
-  u32 repsize;
-  u8 replace[repsize];
-  int count;
+// the matches of the search run during decoding, 0 if it did not cover
+// the code or the first count matches of a patch might have been dropped
+static int fused_take(u64 progid, const patch_set *set, u8 *hits[][PATCH_HITS], int *found)
 {
-  u8 *found;
+  const patch_t *patch;
+  u8 *from;
   int i;
-  u32 at;
+  int k;
 
-  for (i = 0; i < count; i++)
+  if (g_fused.set != set || g_fused.progid != progid || g_fused.done > g_fused.start[PATCH_TEXT])
+  {
+    g_fused.set = NULL;
+    return 0;
+  }
+  g_fused.set = NULL;
+  for (i = 0; i < set->n; i++)
   {
-    found = boyer_moore(start, size, pattern, patsize);
-    if (found == NULL)
+    patch = &set->patches[i];
+    found[i] = 0;
+    from = NULL;
+    for (k = 0; k < g_fused.nkept[i] && found[i] < patch->count; k++)
     {
-      break;
+      if (g_fused.kept[i][k] >= from)
+      {
+        hits[i][found[i]++] = g_fused.kept[i][k];
+        from = g_fused.kept[i][k] + patch->patsize;
+      }
     }
-    at = (u32)(found - start);
-    memcpy(found + offset, replace, repsize);
-    if (at + patsize > size)
+    if (found[i] < patch->count && g_fused.dropped[i] > 0)
     {
-      size = 0;
+      return 0;
     }
-    else
+  }
+  return 1;
+}
+
+// takes the sites recorded for the code if every pattern is still there
+static int sites_match(const patch_sites *sites, const patch_set *set, u8 *base, u32 size, u8 *hits[][PATCH_HITS], int *found)
+{
+  const patch_t *patch;
+  u32 off;
+  int i;
+  int k;
+
+  for (i = 0; i < set->n; i++)
+  {
+    patch = &set->patches[i];
+    found[i] = sites->found[i];
+    if (found[i] > patch->count)
     {
-      size = size - (at + patsize);
+      return 0;
+    }
+    for (k = 0; k < found[i]; k++)
+    {
+      off = sites->offset[i][k];
+      if (off > size || patch->patsize > size - off || memcmp(base + off, patch->pattern, patch->patsize) != 0)
+      {
+        return 0;
+      }
+      hits[i][k] = base + off;
     }
-    start = found + patsize;
   }
-  return i;
+  return 1;
 }
 
-static int file_open(IFile *file, FS_ArchiveID id, const char *path, int flags)
+// Searches each segment once for the patches of the set that target it, then
+// writes the replacements, a NULL replacement leaves that patch's matches
+// alone. Patterns are matched against the unpatched code. Where they matched
+// is recorded, so the next launch of the same code only has to check them.
+static int apply_patches(u64 progid, u32 version, const prog_addrs_t *shared, const exheader_codesetinfo *codeset, const patch_set *set, const u8 *const *replace)
 {
-  FS_Archive archive;
-  FS_Path ppath;
-  size_t len;
-
-  len = strnlen(path, PATH_MAX);
-  archive.id = id;
-  archive.lowPath.type = PATH_EMPTY;
-  archive.lowPath.size = 1;
-  archive.lowPath.data = (u8 *)"";
-  ppath.type = PATH_ASCII;
-  ppath.data = path;
-  ppath.size = len+1;
-  return IFile_Open(file, archive, ppath, flags);
+  u8 *hits[PATCH_MAX][PATCH_HITS];
+  int found[PATCH_MAX];
+  u8 *start[PATCH_SEGMENTS];
+  u32 size[PATCH_SEGMENTS];
+  const patch_t *patch;
+  const patch_sites *cached;
+  patch_sites sites;
+  u8 *base;
+  int total;
+  int seg;
+  int i;
+  int k;
+
+  base = (u8 *)shared->text_addr;
+  sites.progid = progid;
+  sites.hash = patch_sites_hash(version, shared, codeset);
+  cached = patch_sites_find(progid, sites.hash);
+  if (cached == NULL || !sites_match(cached, set, base, shared->total_size << 12, hits, found))
+  {
+    if (!fused_take(progid, set, hits, found))
+    {
+      get_segments(shared, codeset, start, size);
+      memset(found, 0, sizeof(found));
+      for (seg = 0; seg < PATCH_SEGMENTS; seg++)
+      {
+        if (set->scan[seg] != NULL)
+        {
+          find_patches_parallel(start[seg], size[seg], set, set->scan[seg], hits, found);
+        }
+      }
+    }
+
+    memset(sites.found, 0, sizeof(sites.found));
+    memset(sites.offset, 0, sizeof(sites.offset));
+    for (i = 0; i < set->n; i++)
+    {
+      sites.found[i] = found[i];
+      for (k = 0; k < found[i]; k++)
+      {
+        sites.offset[i][k] = hits[i][k] - base;
+      }
+    }
+    patch_sites_store(&sites);
+  }
+
+  total = 0;
+  for (i = 0; i < set->n; i++)
+  {
+    patch = &set->patches[i];
+    for (k = 0; k < found[i] && replace[i] != NULL; k++)
+    {
+      // patches from SD are not trusted to stay inside the code
+      if (hits[i][k] + patch->offset >= base && 
+          hits[i][k] + patch->offset + patch->repsize <= base + (shared->total_size << 12))
+      {
+        memcpy(hits[i][k] + patch->offset, replace[i], patch->repsize);
+      }
+    }
+    total += found[i];
+  }
+  return total;
 }
 
 static int patch_secureinfo()
@@ -204,14 +436,14 @@ static int patch_secureinfo()
   {
     return 0;
   }
-  ret = file_open(&file, ARCHIVE_SDMC, "/SecureInfo_A", FS_OPEN_READ);
+  ret = IFile_OpenPath(&file, ARCHIVE_SDMC, "/SecureInfo_A", FS_OPEN_READ);
   if (R_SUCCEEDED(ret))
   {
     ret = IFile_Read(&file, &total, secureinfo, sizeof(secureinfo));
     IFile_Close(&file);
     if (R_SUCCEEDED(ret) && total == sizeof(secureinfo))
     {
-      ret = file_open(&file, ARCHIVE_NAND_RW, "/sys/SecureInfo_C", FS_OPEN_WRITE | FS_OPEN_CREATE);
+      ret = IFile_OpenPath(&file, ARCHIVE_NAND_RW, "/sys/SecureInfo_C", FS_OPEN_WRITE | FS_OPEN_CREATE);
       if (R_SUCCEEDED(ret))
       {
         ret = IFile_Write(&file, &total, secureinfo, sizeof(secureinfo), FS_WRITE_FLUSH);
@@ -222,7 +454,7 @@ static int patch_secureinfo()
   }
   else // get file from NAND
   {
-    ret = file_open(&file, ARCHIVE_NAND_RW, "/sys/SecureInfo_C", FS_OPEN_READ);
+    ret = IFile_OpenPath(&file, ARCHIVE_NAND_RW, "/sys/SecureInfo_C", FS_OPEN_READ);
     if (R_SUCCEEDED(ret))
     {
       ret = IFile_Read(&file, &total, secureinfo, sizeof(secureinfo));
@@ -236,82 +468,146 @@ static int patch_secureinfo()
   return ret;
 }
 
-int patch_code(u64 progid, u8 *code, u32 size)
+// a set on SD takes the place of the built-in one
+static const patch_set *set_for(u64 progid)
 {
-  if (
-      progid == 0x0004003000008F02LL || // USA Menu
-      progid == 0x0004003000008202LL || // JPN Menu
-      progid == 0x0004003000009802LL || // EUR Menu
-      progid == 0x000400300000A102LL || // CHN Menu
-      progid == 0x000400300000A902LL || // KOR Menu
-      progid == 0x000400300000B102LL    // TWN Menu
-     ) 
+  const patch_set *set;
+  u32 i;
+
+  set = patchfile_find(progid);
+  if (set != NULL)
   {
-    static const char region_free_pattern[] = 
-    {
-      0x00, 0x00, 0x55, 0xE3, 
-      0x01, 0x10, 0xA0, 0xE3
-    };
-    static const char region_free_patch[] = 
-    {
-      0x01, 0x00, 0xA0, 0xE3, 
-      0x1E, 0xFF, 0x2F, 0xE1
-    };
-    patch_memory(code, size, 
-      region_free_pattern, 
-      sizeof(region_free_pattern), -16, 
-      region_free_patch, 
-      sizeof(region_free_patch), 1
-    );
+    return set;
   }
-  else if (progid == 0x0004013000002C02LL) // NIM
+  for (i = 0; i < sizeof(g_builtin) / sizeof(g_builtin[0]); i++)
   {
-    static const char block_updates_pattern[] = 
-    {
-      0x25, 0x79, 0x0B, 0x99
-    };
-    static const char block_updates_patch[] =
-    {
-      0xE3, 0xA0
-    };
-    static const char block_eshop_updates_pattern[] =
+    if (g_builtin[i].progid == progid)
     {
-      0x30, 0xB5, 0xF1, 0xB0
-    };
-    static const char block_eshop_updates_patch[] =
-    {
-      0x00, 0x20, 0x08, 0x60, 
-      0x70, 0x47
-    };
-    static const char country_resp_pattern[] = 
-    {
-      0x01, 0x20, 0x01, 0x90, 
-      0x22, 0x46, 0x06, 0x9B
-    };
-    static const char country_resp_patch_model[] = 
-    {
-      0x06, 0x9A, 0x03, 0x20, 
-      0x90, 0x47, 0x55, 0x21, 
-      0x01, 0x70, 0x53, 0x21, 
-      0x41, 0x70, 0x00, 0x21, 
-      0x81, 0x70, 0x60, 0x61, 
-      0x00, 0x20
-    };
-    const char *country;
-    char country_resp_patch[sizeof(country_resp_patch_model)];
-
-    patch_memory(code, size, 
-      block_updates_pattern, 
-      sizeof(block_updates_pattern), 0, 
-      block_updates_patch, 
-      sizeof(block_updates_patch), 1
-    );
-    patch_memory(code, size, 
-      block_eshop_updates_pattern, 
-      sizeof(block_eshop_updates_pattern), 0, 
-      block_eshop_updates_patch, 
-      sizeof(block_eshop_updates_patch), 1
-    );
+      return g_builtin[i].set;
+    }
+  }
+  return NULL;
+}
+
+static u32 filter_hash(u64 progid)
+{
+  return hash32(0, &progid, sizeof(progid));
+}
+
+static void filter_add(u64 progid)
+{
+  u32 hash;
+
+  hash = filter_hash(progid);
+  g_filter[(hash % PATCH_FILTER_BITS) / 32] |= 1U << (hash % 32);
+  hash >>= 16;
+  g_filter[(hash % PATCH_FILTER_BITS) / 32] |= 1U << (hash % 32);
+}
+
+static int filter_test(u64 progid)
+{
+  u32 hash;
+  u32 a;
+  u32 b;
+
+  hash = filter_hash(progid);
+  a = g_filter[(hash % PATCH_FILTER_BITS) / 32] & (1U << (hash % 32));
+  hash >>= 16;
+  b = g_filter[(hash % PATCH_FILTER_BITS) / 32] & (1U << (hash % 32));
+  return a && b;
+}
+
+// adds the SD file's titles once it is read
+static void filter_complete(void)
+{
+  const patchfile_title *titles;
+  u32 n;
+  u32 i;
+
+  if (g_filter_complete || !patchfile_load())
+  {
+    return;
+  }
+  n = patchfile_titles(&titles);
+  for (i = 0; i < n; i++)
+  {
+    filter_add(titles[i].progid);
+  }
+  g_filter_complete = 1;
+}
+
+void patch_init(void)
+{
+  u32 i;
+
+  for (i = 0; i < sizeof(g_builtin) / sizeof(g_builtin[0]); i++)
+  {
+    filter_add(g_builtin[i].progid);
+  }
+  filter_complete();
+}
+
+// Most titles have no patches, a clear bit in the filter says so without
+// looking at any set. Until the SD file is read every title might have some.
+int patch_needed(u64 progid)
+{
+  g_launches++;
+  filter_complete();
+  if (g_filter_complete && !filter_test(progid))
+  {
+    g_skipped++;
+    return 0;
+  }
+  return 1;
+}
+
+void patch_stats(u32 *launches, u32 *skipped)
+{
+  *launches = g_launches;
+  *skipped = g_skipped;
+}
+
+void patch_scan_begin(u64 progid, const prog_addrs_t *shared, const exheader_codesetinfo *codeset)
+{
+  const patch_set *set;
+
+  g_fused.set = NULL;
+  set = set_for(progid);
+  // recorded sites are cheaper to check than any search
+  if (!PATCH_FUSED_ENABLE || set == NULL || patch_sites_known(progid))
+  {
+    return;
+  }
+  g_fused.progid = progid;
+  get_segments(shared, codeset, g_fused.start, g_fused.size);
+  g_fused.done = g_fused.start[PATCH_DATA] + g_fused.size[PATCH_DATA];
+  memset(g_fused.nkept, 0, sizeof(g_fused.nkept));
+  memset(g_fused.dropped, 0, sizeof(g_fused.dropped));
+  g_fused.set = set;
+}
+
+int patch_code(u64 progid, const prog_addrs_t *shared, const exheader_codesetinfo *codeset)
+{
+  // static as it is only read once the patches are applied
+  static u8 country_resp_patch[sizeof(patch_nim_country_resp_replace)];
+  const u8 *replace[PATCH_MAX];
+  const patch_set *set;
+  const char *country;
+  u32 i;
+
+  set = set_for(progid);
+  if (set == NULL)
+  {
+    return 0;
+  }
+  for (i = 0; i < set->n; i++)
+  {
+    replace[i] = set->patches[i].replace;
+  }
+
+  if (set == &patch_set_nim)
+  {
+    replace[PATCH_NIM_COUNTRY_RESP] = NULL;
     if (R_SUCCEEDED(patch_secureinfo()))
     {
       switch (secureinfo[0x100])
@@ -324,78 +620,24 @@ int patch_code(u64 progid, u8 *code, u32 size)
         case 6: country = "TW"; break;
         default: case 0: country = "JP"; break;
       }
-      // patch XML response Country
       memcpy(country_resp_patch, 
-        country_resp_patch_model, 
-        sizeof(country_resp_patch_model)
+        patch_nim_country_resp_replace, 
+        sizeof(patch_nim_country_resp_replace)
       );
       country_resp_patch[6] = country[0];
       country_resp_patch[10] = country[1];
-      patch_memory(code, size, 
-        country_resp_pattern, 
-        sizeof(country_resp_pattern), 0, 
-        country_resp_patch, 
-        sizeof(country_resp_patch), 1
-      );
+      replace[PATCH_NIM_COUNTRY_RESP] = country_resp_patch;
     }
   }
-  else if (progid == 0x0004013000008002LL) // NS
-  {
-    static const char stop_updates_pattern[] = 
-    {
-      0x0C, 0x18, 0xE1, 0xD8
-    };
-    static const char stop_updates_patch[] = 
-    {
-      0x0B, 0x18, 0x21, 0xC8
-    };
-    patch_memory(code, size, 
-      stop_updates_pattern, 
-      sizeof(stop_updates_pattern), 0, 
-      stop_updates_patch, 
-      sizeof(stop_updates_patch), 2
-    );
-  }
-  else if (progid == 0x0004013000001702LL) // CFG
+  else if (set == &patch_set_cfg)
   {
-    static const char secureinfo_sig_check_pattern[] = 
-    {
-      0x06, 0x46, 0x10, 0x48, 0xFC
-    };
-    static const char secureinfo_sig_check_patch[] = 
+    // use SecureInfo_C only once it is there
+    if (R_FAILED(patch_secureinfo()))
     {
-      0x00, 0x26
-    };
-    static const char secureinfo_filename_pattern[] = 
-    {
-      0x53, 0x00, 0x65, 0x00, 
-      0x63, 0x00, 0x75, 0x00, 
-      0x72, 0x00, 0x65, 0x00, 
-      0x49, 0x00, 0x6E, 0x00, 
-      0x66, 0x00, 0x6F, 0x00, 
-      0x5F, 0x00
-    };
-    static const char secureinfo_filename_patch[] = 
-    {
-      0x43, 0x00
-    };
-    // disable SecureInfo signature check
-    patch_memory(code, size, 
-      secureinfo_sig_check_pattern, 
-      sizeof(secureinfo_sig_check_pattern), 0, 
-      secureinfo_sig_check_patch, 
-      sizeof(secureinfo_sig_check_patch), 1
-    );
-    if (R_SUCCEEDED(patch_secureinfo()))
-    {
-      // use SecureInfo_C
-      patch_memory(code, size, 
-        secureinfo_filename_pattern, 
-        sizeof(secureinfo_filename_pattern), 22, 
-        secureinfo_filename_patch, 
-        sizeof(secureinfo_filename_patch), 2
-      );
+      replace[PATCH_CFG_SECUREINFO_FILENAME] = NULL;
     }
   }
+  apply_patches(progid, set == patchfile_find(progid) ? patchfile_hash() : PATCH_SET_VERSION, 
+    shared, codeset, set, replace);
   return 0;
 }
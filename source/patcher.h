@@ -1,5 +1,19 @@
 #pragma once
 
 #include <3ds/types.h>
+#include "exheader.h"
+#include "loader.h"
 
-int patch_code(u64 progid, u8 *code, u32 size);
+// builds the filter of titles with patches, at service start
+void patch_init(void);
+// 0 if progid certainly has no patches, counted as a launch that skipped them
+int patch_needed(u64 progid);
+void patch_stats(u32 *launches, u32 *skipped);
+
+// patches the code loaded at `shared`, codeset gives the exact segment sizes
+int patch_code(u64 progid, const prog_addrs_t *shared, const exheader_codesetinfo *codeset);
+
+// searches the code for its patches while it is being decoded, the decoder
+// reports that the bytes from `final` up will not change any more
+void patch_scan_begin(u64 progid, const prog_addrs_t *shared, const exheader_codesetinfo *codeset);
+void patch_scan_final(u8 *final);
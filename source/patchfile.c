@@ -0,0 +1,204 @@
+#include <3ds.h>
+#include <string.h>
+#include "patchfile.h"
+#include "hash.h"
+#include "ifile.h"
+
+// Patch sets can also come from /loader/patches.bin on SD, so patches can be
+// added without rebuilding the loader. The file is read once into a fixed
+// arena, at service start or on a later launch if SD was not up yet. Once
+// SD is up without the file there are no patches from it. A launch then
+// only looks its program ID up in the sorted title index.
+#ifndef PATCHFILE_ENABLE
+#define PATCHFILE_ENABLE 0
+#endif
+
+#ifndef PATCHFILE_ARENA_SIZE
+#define PATCHFILE_ARENA_SIZE 0x4000
+#endif
+
+#define PATCHFILE_PATH "/loader/patches.bin"
+
+static u8 g_arena[PATCHFILE_ARENA_SIZE] ALIGN(8);
+static const patchfile_header *g_header; // NULL if there are no patches
+static const patchfile_title *g_titles;
+static const patchfile_set *g_sets;
+static const patchfile_patch *g_patches;
+static const u8 *g_data;
+static u32 g_hash;
+static int g_loaded;
+
+// the set last looked up, its search tables are built on demand
+static patch_set g_set;
+static patch_t g_set_patches[PATCH_MAX];
+static patch_scan g_set_scan[PATCH_SEGMENTS];
+static u32 g_set_index;
+
+static int check_file(u32 size)
+{
+  const patchfile_header *header;
+  const patchfile_patch *patch;
+  u32 records;
+  u32 i;
+
+  header = (const patchfile_header *)g_arena;
+  if (size < sizeof(*header) || header->magic != PATCHFILE_MAGIC || header->version != PATCHFILE_VERSION ||
+      header->titles > size || header->sets > size || header->patches > size || header->data_size > size)
+  {
+    return 0;
+  }
+  records = sizeof(*header) + header->titles * sizeof(patchfile_title) +
+    header->sets * sizeof(patchfile_set) + header->patches * sizeof(patchfile_patch);
+  if (records + header->data_size != size)
+  {
+    return 0;
+  }
+  g_titles = (const patchfile_title *)(header + 1);
+  g_sets = (const patchfile_set *)(g_titles + header->titles);
+  g_patches = (const patchfile_patch *)(g_sets + header->sets);
+  g_data = g_arena + records;
+
+  for (i = 0; i < header->titles; i++)
+  {
+    if (g_titles[i].set >= header->sets || (i > 0 && g_titles[i].progid <= g_titles[i - 1].progid))
+    {
+      return 0;
+    }
+  }
+  for (i = 0; i < header->sets; i++)
+  {
+    if (g_sets[i].count == 0 || g_sets[i].count > PATCH_MAX || g_sets[i].first + g_sets[i].count > header->patches)
+    {
+      return 0;
+    }
+  }
+  for (i = 0; i < header->patches; i++)
+  {
+    patch = &g_patches[i];
+    if (patch->segment >= PATCH_SEGMENTS || patch->count < 1 || patch->count > PATCH_HITS ||
+        patch->patsize < PATCH_MIN_LEN || patch->repsize == 0 ||
+        patch->pattern > header->data_size || patch->patsize > header->data_size - patch->pattern ||
+        patch->replace > header->data_size || patch->repsize > header->data_size - patch->replace)
+    {
+      return 0;
+    }
+  }
+  g_header = header;
+  return 1;
+}
+
+int patchfile_load(void)
+{
+  IFile file;
+  u64 size;
+  u64 total;
+  Result res;
+
+  if (!PATCHFILE_ENABLE || g_loaded)
+  {
+    return 1;
+  }
+  // fails until SD is mounted
+  res = IFile_OpenPath(&file, ARCHIVE_SDMC, PATCHFILE_PATH, FS_OPEN_READ);
+  if (res == IFILE_NOT_FOUND)
+  {
+    g_loaded = 1;
+    return 1;
+  }
+  if (R_FAILED(res))
+  {
+    return 0;
+  }
+  res = IFile_GetSize(&file, &size);
+  if (R_SUCCEEDED(res) && size > 0 && size <= sizeof(g_arena))
+  {
+    res = IFile_Read(&file, &total, g_arena, (u32)size);
+    if (R_SUCCEEDED(res) && total == size && check_file((u32)size))
+    {
+      g_hash = hash32(PATCHFILE_VERSION, g_arena, (u32)size);
+    }
+  }
+  IFile_Close(&file);
+  // a file that is too large or damaged is not read again either
+  g_set_index = ~0;
+  g_loaded = 1;
+  return 1;
+}
+
+static void build_set(u32 index)
+{
+  const patchfile_set *set;
+  const patchfile_patch *patch;
+  u8 segments[PATCH_MAX];
+  u32 i;
+  int seg;
+
+  set = &g_sets[index];
+  g_set.n = set->count;
+  g_set.patches = g_set_patches;
+  for (i = 0; i < set->count; i++)
+  {
+    patch = &g_patches[set->first + i];
+    g_set_patches[i].pattern = g_data + patch->pattern;
+    g_set_patches[i].patsize = patch->patsize;
+    g_set_patches[i].offset = patch->offset;
+    g_set_patches[i].replace = g_data + patch->replace;
+    g_set_patches[i].repsize = patch->repsize;
+    g_set_patches[i].count = patch->count;
+    segments[i] = patch->segment;
+  }
+  memset(g_set.next, NO_PATCH, sizeof(g_set.next));
+  for (seg = 0; seg < PATCH_SEGMENTS; seg++)
+  {
+    patch_make_scan(&g_set_scan[seg], g_set.next, g_set_patches, segments, g_set.n, seg);
+    g_set.scan[seg] = g_set_scan[seg].n > 0 ? &g_set_scan[seg] : NULL;
+  }
+  g_set_index = index;
+}
+
+const patch_set *patchfile_find(u64 progid)
+{
+  u32 lo;
+  u32 hi;
+  u32 mid;
+
+  patchfile_load();
+  if (g_header == NULL)
+  {
+    return NULL;
+  }
+  lo = 0;
+  hi = g_header->titles;
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+    if (g_titles[mid].progid < progid)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  if (lo == g_header->titles || g_titles[lo].progid != progid)
+  {
+    return NULL;
+  }
+  if (g_titles[lo].set != g_set_index)
+  {
+    build_set(g_titles[lo].set);
+  }
+  return &g_set;
+}
+
+u32 patchfile_titles(const patchfile_title **titles)
+{
+  *titles = g_titles;
+  return g_header != NULL ? g_header->titles : 0;
+}
+
+u32 patchfile_hash(void)
+{
+  return g_hash;
+}
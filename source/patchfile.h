@@ -0,0 +1,57 @@
+#pragma once
+
+#include <3ds/types.h>
+#include "patchset.h"
+
+// /loader/patches.bin, written by host/patchpack.c, little endian:
+//   patchfile_header
+//   patchfile_title[titles], sorted by program ID
+//   patchfile_set[sets]
+//   patchfile_patch[patches]
+//   data_size bytes of patterns and replacements
+#define PATCHFILE_MAGIC 0x46504C4C // "LLPF"
+#define PATCHFILE_VERSION 1
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 titles;
+  u32 sets;
+  u32 patches;
+  u32 data_size;
+} patchfile_header;
+
+typedef struct
+{
+  u64 progid;
+  u32 set;
+  u32 reserved;
+} patchfile_title;
+
+typedef struct
+{
+  u16 first; // index of the set's first patch
+  u16 count;
+} patchfile_set;
+
+typedef struct
+{
+  u8 segment;
+  u8 count;
+  u8 patsize;
+  u8 repsize;
+  s32 offset;
+  u32 pattern; // offsets into the data
+  u32 replace;
+} patchfile_patch;
+
+// reads the file into memory unless that was done already, returns 1 once
+// it was read or there is none to read
+int patchfile_load(void);
+// the titles the file has patches for, sorted, returns their count
+u32 patchfile_titles(const patchfile_title **titles);
+// the patches the file has for progid, NULL if it has none
+const patch_set *patchfile_find(u64 progid);
+// changes with the file's content
+u32 patchfile_hash(void);
@@ -0,0 +1,49 @@
+#include <3ds/types.h>
+#include <string.h>
+#include "patchset.h"
+
+void patch_make_scan(patch_scan *scan, u8 *next, const patch_t *patches, const u8 *segments, u32 n, int segment)
+{
+  const patch_t *patch;
+  u32 i;
+  u32 j;
+
+  scan->n = 0;
+  scan->winlen = 0xFF; // shifts are kept in bytes
+  scan->maxlen = 0;
+  for (i = 0; i < n; i++)
+  {
+    if (segments[i] == segment)
+    {
+      scan->n++;
+      if (patches[i].patsize < scan->winlen)
+      {
+        scan->winlen = patches[i].patsize;
+      }
+      if (patches[i].patsize > scan->maxlen)
+      {
+        scan->maxlen = patches[i].patsize;
+      }
+    }
+  }
+  memset(scan->shift, scan->winlen, sizeof(scan->shift));
+  memset(scan->head, NO_PATCH, sizeof(scan->head));
+  // walk backwards so chains list patches in definition order
+  for (i = n; i-- > 0;)
+  {
+    patch = &patches[i];
+    if (segments[i] != segment)
+    {
+      continue;
+    }
+    for (j = 0; j < scan->winlen - 1; j++)
+    {
+      if (scan->shift[patch->pattern[j]] > scan->winlen - 1 - j)
+      {
+        scan->shift[patch->pattern[j]] = scan->winlen - 1 - j;
+      }
+    }
+    next[i] = scan->head[patch->pattern[scan->winlen - 1]];
+    scan->head[patch->pattern[scan->winlen - 1]] = i;
+  }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// Patch sets are defined in patches.def and turned into patch_tables.h by
+// host/patchgen.c at build time, so the search tables are const data. Sets
+// read from SD (see patchfile.c) get theirs at launch.
+
+#define PATCH_MAX 8    // patches in one set
+#define PATCH_HITS 4   // matches patched per pattern
+#define PATCH_MIN_LEN 4
+#define NO_PATCH 0xFF
+
+typedef enum
+{
+  PATCH_TEXT = 0,
+  PATCH_RO,
+  PATCH_DATA,
+  PATCH_ALL,      // text to the end of data as one search
+  PATCH_SEGMENTS,
+} patch_segment;
+
+typedef struct
+{
+  const u8 *pattern;
+  u32 patsize;
+  int offset; // of the replacement from the start of a match
+  const u8 *replace;
+  u32 repsize;
+  int count;  // non-overlapping matches to patch
+} patch_t;
+
+// Horspool tables for the patches of a set in one segment, over a window as
+// long as their shortest pattern: shift[c] is how far the window moves when
+// it ends on byte c, head[c] the first patch whose window ends on c, followed
+// by the set's next[] until NO_PATCH
+typedef struct
+{
+  u32 n;
+  u32 winlen;
+  u32 maxlen; // longest pattern
+  u8 shift[256];
+  u8 head[256];
+} patch_scan;
+
+typedef struct
+{
+  u32 n;
+  u8 next[PATCH_MAX];
+  const patch_t *patches;
+  const patch_scan *scan[PATCH_SEGMENTS]; // NULL if no patch is in the segment
+} patch_set;
+
+// fills in scan for the patches in segment, segments[i] is the segment of
+// patches[i], and links their chains through next
+void patch_make_scan(patch_scan *scan, u8 *next, const patch_t *patches, const u8 *segments, u32 n, int segment);
@@ -0,0 +1,163 @@
+#include <3ds.h>
+#include <string.h>
+#include "patchsites.h"
+#include "hash.h"
+#include "ifile.h"
+
+// Patch sites of the last few patched titles, kept in memory and in a small
+// file on SD so repeat launches, also after a reboot, patch the recorded
+// offsets instead of scanning. The file is only written if /loader/ exists.
+#ifndef PATCH_SITES_ENABLE
+#define PATCH_SITES_ENABLE 0
+#endif
+
+#define PATCH_SITES_PATH "/loader/patch_sites.bin"
+#define PATCH_SITES_MAX 8
+
+#define SITES_MAGIC 0x53504C4C // "LLPS"
+#define SITES_VERSION 2
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 next; // slot replaced by the next new title
+  u32 reserved;
+  patch_sites entries[PATCH_SITES_MAX];
+} sites_file;
+
+static sites_file g_sites;
+static int g_sites_loaded;
+static int g_sites_nodir; // SD is up without /loader/
+
+// The file is read on first use once SD is up. Titles recorded before that
+// stay in memory and replace what the file had.
+static int sites_load(void)
+{
+  IFile file;
+  u64 total;
+  Result res;
+  int i;
+
+  if (g_sites_loaded)
+  {
+    return 1;
+  }
+  // fails until SD is mounted, a missing file is an empty one
+  res = IFile_OpenPath(&file, ARCHIVE_SDMC, PATCH_SITES_PATH, FS_OPEN_READ);
+  if (R_FAILED(res) && res != IFILE_NOT_FOUND)
+  {
+    return 0;
+  }
+  if (R_SUCCEEDED(res))
+  {
+    for (i = 0; i < PATCH_SITES_MAX && g_sites.entries[i].progid == 0; i++);
+    if (i == PATCH_SITES_MAX)
+    {
+      res = IFile_Read(&file, &total, &g_sites, sizeof(g_sites));
+      if (R_FAILED(res) || total != sizeof(g_sites) ||
+          g_sites.magic != SITES_MAGIC || g_sites.version != SITES_VERSION || g_sites.next >= PATCH_SITES_MAX)
+      {
+        memset(&g_sites, 0, sizeof(g_sites));
+      }
+    }
+    IFile_Close(&file);
+  }
+  g_sites.magic = SITES_MAGIC;
+  g_sites.version = SITES_VERSION;
+  g_sites_loaded = 1;
+  return 1;
+}
+
+static void sites_save(void)
+{
+  IFile file;
+  u64 total;
+  Result res;
+
+  if (g_sites_nodir)
+  {
+    return;
+  }
+  res = IFile_OpenPath(&file, ARCHIVE_SDMC, PATCH_SITES_PATH, FS_OPEN_WRITE | FS_OPEN_CREATE);
+  if (R_SUCCEEDED(res))
+  {
+    IFile_Write(&file, &total, &g_sites, sizeof(g_sites), FS_WRITE_FLUSH);
+    IFile_Close(&file);
+  }
+  g_sites_nodir = res == IFILE_NOT_FOUND;
+}
+
+// Hashes the code set info, which has the segment sizes and the remaster
+// version, and all of each segment. Sites are only taken for the very code
+// they were found in, a pattern added or moved by a rebuild is searched for.
+u32 patch_sites_hash(u32 seed, const prog_addrs_t *shared, const exheader_codesetinfo *codeset)
+{
+  u32 hash;
+
+  hash = hash32(seed, codeset, sizeof(*codeset));
+  hash = hash32(hash, (const u8 *)shared->text_addr, codeset->text.codesize);
+  hash = hash32(hash, (const u8 *)shared->ro_addr, codeset->ro.codesize);
+  return hash32(hash, (const u8 *)shared->data_addr, codeset->data.codesize);
+}
+
+const patch_sites *patch_sites_find(u64 progid, u32 hash)
+{
+  int i;
+
+  if (!PATCH_SITES_ENABLE)
+  {
+    return NULL;
+  }
+  sites_load();
+  for (i = 0; i < PATCH_SITES_MAX; i++)
+  {
+    if (g_sites.entries[i].progid == progid && g_sites.entries[i].hash == hash)
+    {
+      return &g_sites.entries[i];
+    }
+  }
+  return NULL;
+}
+
+int patch_sites_known(u64 progid)
+{
+  int i;
+
+  if (!PATCH_SITES_ENABLE)
+  {
+    return 0;
+  }
+  sites_load();
+  for (i = 0; i < PATCH_SITES_MAX; i++)
+  {
+    if (g_sites.entries[i].progid == progid)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void patch_sites_store(const patch_sites *sites)
+{
+  patch_sites *entry;
+  int i;
+
+  if (!PATCH_SITES_ENABLE)
+  {
+    return;
+  }
+  for (i = 0; i < PATCH_SITES_MAX && g_sites.entries[i].progid != sites->progid; i++);
+  if (i == PATCH_SITES_MAX)
+  {
+    i = g_sites.next;
+    g_sites.next = (g_sites.next + 1) % PATCH_SITES_MAX;
+  }
+  entry = &g_sites.entries[i];
+  *entry = *sites;
+  if (sites_load())
+  {
+    sites_save();
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <3ds/types.h>
+#include "exheader.h"
+#include "loader.h"
+#include "patchset.h"
+
+// where the patches of a title matched the last time it was scanned
+typedef struct
+{
+  u64 progid;
+  u32 hash;                           // patch_sites_hash of the code
+  u8 found[PATCH_MAX];                // matches of each patch
+  u32 offset[PATCH_MAX][PATCH_HITS];  // from the start of text
+} patch_sites;
+
+u32 patch_sites_hash(u32 seed, const prog_addrs_t *shared, const exheader_codesetinfo *codeset);
+const patch_sites *patch_sites_find(u64 progid, u32 hash);
+// whether sites were recorded for any code of progid
+int patch_sites_known(u64 progid);
+void patch_sites_store(const patch_sites *sites);
@@ -0,0 +1,110 @@
+#include <3ds.h>
+#include <string.h>
+#include "profile.h"
+#include "ifile.h"
+
+#ifndef PROFILE_ENABLE
+#define PROFILE_ENABLE 1
+#endif
+
+// host builds can time with their own clock
+#ifndef PROFILE_TICK
+#define PROFILE_TICK() svcGetSystemTick()
+#endif
+
+#define PROFILE_PATH "/loader/profile.bin"
+#define PROFILE_MAGIC 0x504C4C4C // "LLLP"
+#define PROFILE_VERSION 2
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 tick_rate;
+  u32 count;
+} profile_file_header;
+
+static profile_record g_records[PROFILE_RECORDS];
+static u32 g_count; // records ever made, the oldest is overwritten first
+static profile_record g_current;
+static u64 g_begin;
+
+u64 profile_tick(void)
+{
+  return PROFILE_ENABLE ? PROFILE_TICK() : 0;
+}
+
+void profile_begin(void)
+{
+  memset(&g_current, 0, sizeof(g_current));
+  g_begin = profile_tick();
+}
+
+void profile_add(profile_stage stage, u64 start)
+{
+  g_current.ticks[stage] += (u32)(profile_tick() - start);
+}
+
+void profile_end(u64 progid, Result result)
+{
+  if (!PROFILE_ENABLE)
+  {
+    return;
+  }
+  g_current.progid = progid;
+  g_current.result = result;
+  g_current.total = (u32)(profile_tick() - g_begin);
+  g_records[g_count % PROFILE_RECORDS] = g_current;
+  g_count++;
+}
+
+u32 profile_read(profile_record *out, u32 max)
+{
+  u32 first;
+  u32 i;
+
+  first = g_count > PROFILE_RECORDS ? g_count - PROFILE_RECORDS : 0;
+  if (g_count - first > max)
+  {
+    first = g_count - max;
+  }
+  for (i = first; i < g_count; i++)
+  {
+    out[i - first] = g_records[i % PROFILE_RECORDS];
+  }
+  return g_count - first;
+}
+
+Result profile_dump(const profile_record *records, u32 count)
+{
+  IFile file;
+  profile_file_header header;
+  u64 total;
+  Result res;
+
+  res = IFile_OpenPath(&file, ARCHIVE_SDMC, PROFILE_PATH, FS_OPEN_WRITE | FS_OPEN_CREATE);
+  if (R_FAILED(res))
+  {
+    return res;
+  }
+  header.magic = PROFILE_MAGIC;
+  header.version = PROFILE_VERSION;
+  header.tick_rate = SYSCLOCK_ARM11;
+  header.count = count;
+  res = IFile_SetSize(&file, 0);
+  if (R_SUCCEEDED(res))
+  {
+    res = IFile_Write(&file, &total, &header, sizeof(header), 0);
+  }
+  if (R_SUCCEEDED(res))
+  {
+    res = IFile_Write(&file, &total, (void *)records, count * sizeof(profile_record), FS_WRITE_FLUSH);
+  }
+  IFile_Close(&file);
+  return res;
+}
+
+void profile_clear(void)
+{
+  g_count = 0;
+}
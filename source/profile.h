@@ -0,0 +1,43 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// Per-stage timing of the last PROFILE_RECORDS process loads, in system
+// ticks (SYSCLOCK_ARM11 per second).
+
+#define PROFILE_RECORDS 16
+
+typedef enum
+{
+  PROFILE_EXHEADER = 0, // fetching the exheader, 0 when it was cached
+  PROFILE_OPEN,         // opening .code and getting its size
+  PROFILE_READ,         // reading .code, decompression included
+  PROFILE_DECOMPRESS,   // the part of PROFILE_READ spent decoding
+  PROFILE_PATCH,
+  PROFILE_CODESET,      // svcCreateCodeSet
+  PROFILE_PROCESS,      // svcCreateProcess
+  PROFILE_STAGES,
+} profile_stage;
+
+typedef struct
+{
+  u64 progid;
+  Result result;
+  u32 total;
+  u32 ticks[PROFILE_STAGES];
+} profile_record;
+
+// profile dump flags of the GetLoadProfile command
+#define PROFILE_DUMP_SD BIT(0) // also write the records to /loader/profile.bin, and the trace
+#define PROFILE_CLEAR BIT(1)   // forget the records once returned
+
+u64 profile_tick(void);
+void profile_begin(void);
+// adds the ticks since `start` to a stage of the load in progress
+void profile_add(profile_stage stage, u64 start);
+void profile_end(u64 progid, Result result);
+
+// copies up to `max` records, oldest first, and returns how many
+u32 profile_read(profile_record *out, u32 max);
+Result profile_dump(const profile_record *records, u32 count);
+void profile_clear(void);
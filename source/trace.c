@@ -0,0 +1,181 @@
+#include <3ds.h>
+#include <string.h>
+#include "trace.h"
+#include "ifile.h"
+
+// The service can record every request it receives, when it came and what
+// it was replied, to replay boots and launches on the host. Records collect
+// in one half of an arena, which is set aside once it is half full and
+// appended to the file on SD while new records go to the other half. The
+// caller writes it out without holding its state lock, so commands are not
+// held up by SD. SD is not up early in a boot, so records are kept until it
+// is, and whatever does not fit by then is only counted. The file is
+// started over by the first write of a boot, /loader/ has to exist.
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 0
+#endif
+
+#ifndef TRACE_ARENA_SIZE
+#define TRACE_ARENA_SIZE 0x2000
+#endif
+
+#define TRACE_PATH "/loader/trace.bin"
+#define RECORD_WORDS (sizeof(trace_record) / 4)
+#define HALF_WORDS (TRACE_ARENA_SIZE / 8)
+
+static u32 g_arena[2][HALF_WORDS];
+static u32 g_active;  // the half records go to
+static u32 g_used;    // words of it in use
+static u32 g_pending; // records still waiting for their reply
+static u32 g_records; // ever made, written or not
+static u32 g_dropped;
+static u64 g_last;    // tick of the last request, 0 before the first
+static int g_flush;   // set aside once no record waits for its reply
+
+// the half set aside, only trace_write touches it while it is taken
+static u32 g_out_used; // words of it to write, 0 if none
+static u32 g_out_records;
+static u32 g_out_dropped;
+static int g_taken;
+static u32 g_written; // bytes of records in the file, if it was started
+static int g_started;
+
+static u32 ticks_to_usec(u64 ticks)
+{
+  u64 usec;
+
+  usec = ticks * 1000000 / SYSCLOCK_ARM11;
+  return usec > 0xFFFFFFFF ? 0xFFFFFFFF : (u32)usec;
+}
+
+u32 trace_request_words(u32 header)
+{
+  u32 words;
+
+  words = 1 + ((header >> 6) & 0x3F) + (header & 0x3F);
+  return words > TRACE_MAX_WORDS ? TRACE_MAX_WORDS : words;
+}
+
+u32 trace_request(const u32 *cmdbuf)
+{
+  trace_record *record;
+  u32 words;
+  u32 trace;
+  u64 now;
+
+  if (!TRACE_ENABLE)
+  {
+    return TRACE_NONE;
+  }
+  now = svcGetSystemTick();
+  words = trace_request_words(cmdbuf[0]);
+  if (g_used + RECORD_WORDS + words > HALF_WORDS)
+  {
+    g_dropped++;
+    return TRACE_NONE;
+  }
+  trace = g_used;
+  record = (trace_record *)&g_arena[g_active][trace];
+  record->delta = g_last != 0 ? ticks_to_usec(now - g_last) : 0;
+  record->busy = (u32)now; // until the reply
+  memcpy(record + 1, cmdbuf, words * 4);
+  g_last = now;
+  g_used += RECORD_WORDS + words;
+  g_records++;
+  g_pending++;
+  return trace;
+}
+
+void trace_reply(u32 trace, const u32 *cmdbuf)
+{
+  trace_record *record;
+
+  if (trace == TRACE_NONE)
+  {
+    return;
+  }
+  record = (trace_record *)&g_arena[g_active][trace];
+  record->busy = ticks_to_usec((u32)svcGetSystemTick() - record->busy);
+  memcpy(record->reply, &cmdbuf[1], sizeof(record->reply));
+  g_pending--;
+  if (g_used * 2 >= HALF_WORDS)
+  {
+    g_flush = 1;
+  }
+}
+
+void trace_flush(void)
+{
+  g_flush = 1;
+}
+
+// the half is only set aside once no record in it waits for its reply, and
+// the last one is written; a failed write is tried again at the next take
+int trace_take(void)
+{
+  if (!TRACE_ENABLE || g_taken)
+  {
+    return 0;
+  }
+  if (g_out_used == 0 && g_flush && g_pending == 0 && g_used != 0)
+  {
+    g_out_used = g_used;
+    g_out_records = g_records;
+    g_out_dropped = g_dropped;
+    g_active ^= 1;
+    g_used = 0;
+    g_flush = 0;
+  }
+  g_taken = g_out_used != 0;
+  return g_taken;
+}
+
+Result trace_write(void)
+{
+  trace_file_header header;
+  IFile file;
+  u64 total;
+  Result res;
+
+  res = IFile_OpenPath(&file, ARCHIVE_SDMC, TRACE_PATH, FS_OPEN_WRITE | FS_OPEN_CREATE);
+  if (R_FAILED(res))
+  {
+    return res;
+  }
+  if (!g_started)
+  {
+    res = IFile_SetSize(&file, 0);
+    g_written = 0;
+  }
+  if (R_SUCCEEDED(res))
+  {
+    file.pos = sizeof(header) + g_written;
+    res = IFile_Write(&file, &total, g_arena[g_active ^ 1], g_out_used * 4, 0);
+  }
+  if (R_SUCCEEDED(res))
+  {
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.records = g_out_records;
+    header.dropped = g_out_dropped;
+    header.size = g_written + g_out_used * 4;
+    file.pos = 0;
+    res = IFile_Write(&file, &total, &header, sizeof(header), FS_WRITE_FLUSH);
+  }
+  IFile_Close(&file);
+  if (R_SUCCEEDED(res))
+  {
+    g_written += g_out_used * 4;
+    g_started = 1;
+  }
+  return res;
+}
+
+void trace_written(Result res)
+{
+  if (R_SUCCEEDED(res))
+  {
+    g_out_used = 0;
+  }
+  g_taken = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// /loader/trace.bin, the requests the service received, little endian:
+//   trace_file_header
+//   records, each a trace_record followed by the request's words
+// host/trace_replay.c plays it back.
+#define TRACE_MAGIC 0x52544C4C // "LLTR"
+#define TRACE_VERSION 1
+
+// requests are recorded up to this many words
+#define TRACE_MAX_WORDS 16
+#define TRACE_NONE 0xFFFFFFFF
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 records;
+  u32 dropped; // requests that did not fit before SD was up
+  u32 size;    // bytes of records after the header
+} trace_file_header;
+
+typedef struct
+{
+  u32 delta;    // usec since the request before
+  u32 busy;     // usec until it was replied to
+  u32 reply[3]; // the result and the first two words after it
+} trace_record;
+
+// the words a request with this header is recorded with
+u32 trace_request_words(u32 header);
+// records the request in cmdbuf, returns what to pass to trace_reply
+u32 trace_request(const u32 *cmdbuf);
+// completes the record with the reply in cmdbuf
+void trace_reply(u32 trace, const u32 *cmdbuf);
+// has the records written out to SD, once the requests in progress are
+// replied to
+void trace_flush(void);
+// sets records aside to be written if it is time to, and returns whether
+// there are any; the caller then calls trace_write without its state lock
+// and passes the result to trace_written
+int trace_take(void);
+Result trace_write(void);
+void trace_written(Result res);
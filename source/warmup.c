@@ -0,0 +1,358 @@
+#include <3ds.h>
+#include <string.h>
+#include "exhcache.h"
+#include "fsreg.h"
+#include "warmup.h"
+#include "worker.h"
+
+// pm reads a title's exheader with GetProgramInfo and launches the programs
+// in its dependency list next, each with its own round-trips to FS. Once the
+// exheader is out, the dependencies pm has not registered yet are registered
+// with FS here and their exheaders fetched, on a worker thread. When pm then
+// registers one of them on NAND it gets the registration made here, so FS is
+// asked once per program either way, and its exheader comes with it.
+//
+// GetProgramInfo can return several exheaders at once but takes a single
+// handle, so handles FS gave out one after another are fetched together and
+// each result is checked against the program it was meant for. Anything
+// that does not check out is fetched on its own.
+//
+// The command thread never waits for the worker: a program pm registers
+// while it is still fetching is registered as usual, and the dependencies of
+// a title read meanwhile are not fetched ahead. A registration no one claims
+// is dropped by the worker when its slot is taken again.
+#ifndef WARMUP_ENABLE
+#define WARMUP_ENABLE 0
+#endif
+
+// exheaders kept, 1KB each
+#ifndef WARMUP_ENTRIES
+#define WARMUP_ENTRIES 8
+#endif
+
+// programs registered by pm the warm-up knows of, 16 bytes each
+#ifndef WARMUP_REGISTERED
+#define WARMUP_REGISTERED 64
+#endif
+
+#define WARMUP_STACK_SIZE 0x1000
+#define DEPLIST_COUNT 0x30
+#define SLOT_PENDING ~0ULL
+
+typedef struct
+{
+  u64 progid;
+  u32 slot;
+  u64 stale_handle; // the slot's last registration, 0 if it had none
+  u64 prog_handle; // 0 if FS did not register it
+  int ok;
+} warmup_job;
+
+typedef struct
+{
+  u64 prog_handle; // 0 if the entry is free
+  u64 progid;
+} registration;
+
+// the table is only touched by the command thread, the worker fills in the
+// slots of the jobs it was given
+static u64 g_progids[WARMUP_ENTRIES]; // 0 if the slot is free, or SLOT_PENDING
+static u64 g_handles[WARMUP_ENTRIES]; // can outlive the slot's program
+static exheader_header g_exheaders[WARMUP_ENTRIES];
+static u32 g_next;
+
+static registration g_registered[WARMUP_REGISTERED];
+
+static warmup_job g_jobs[WARMUP_ENTRIES];
+static u32 g_job_count;
+static int g_running;
+static worker_t g_worker;
+static u8 g_stack[WARMUP_STACK_SIZE] ALIGN(8);
+
+// fetches the exheaders of jobs first to first + count - 1 in one request,
+// returns how many from the first on check out
+static u32 fetch_checked(u32 first, u32 count)
+{
+  u64 progids[WARMUP_ENTRIES];
+  u32 i;
+
+  for (i = 0; i < count; i++)
+  {
+    progids[i] = g_jobs[first + i].progid;
+  }
+  return exhcache_fetch(g_jobs[first].prog_handle, progids, count, &g_exheaders[g_jobs[first].slot]);
+}
+
+static void warmup_main(void *arg)
+{
+  FS_ProgramInfo info;
+  warmup_job *job;
+  u32 first;
+  u32 count;
+  u32 checked;
+  u32 i;
+
+  memset(&info, 0, sizeof(info));
+  info.mediaType = MEDIATYPE_NAND;
+  for (i = 0; i < g_job_count; i++)
+  {
+    if (g_jobs[i].stale_handle != 0)
+    {
+      FSREG_UnloadProgram(g_jobs[i].stale_handle);
+    }
+  }
+  for (i = 0; i < g_job_count; i++)
+  {
+    info.programId = g_jobs[i].progid;
+    if (R_FAILED(FSREG_LoadProgram(&g_jobs[i].prog_handle, &info)))
+    {
+      g_jobs[i].prog_handle = 0;
+    }
+  }
+
+  for (first = 0; first < g_job_count; first += count)
+  {
+    // a run of consecutive slots and handles
+    for (count = 1; first + count < g_job_count; count++)
+    {
+      job = &g_jobs[first + count];
+      if (job->prog_handle == 0 || job->slot != job[-1].slot + 1 || job->prog_handle != job[-1].prog_handle + 1)
+      {
+        break;
+      }
+    }
+    if (g_jobs[first].prog_handle == 0)
+    {
+      continue;
+    }
+    checked = fetch_checked(first, count);
+    for (i = first; i < first + count; i++)
+    {
+      g_jobs[i].ok = i < first + checked || (count > 1 && fetch_checked(i, 1) == 1);
+    }
+  }
+
+  for (i = 0; i < g_job_count; i++)
+  {
+    if (g_jobs[i].prog_handle != 0 && !g_jobs[i].ok)
+    {
+      FSREG_UnloadProgram(g_jobs[i].prog_handle);
+      g_jobs[i].prog_handle = 0;
+    }
+  }
+}
+
+static int find(u64 progid)
+{
+  int i;
+
+  for (i = 0; i < WARMUP_ENTRIES; i++)
+  {
+    if (g_progids[i] == progid)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int queued(u64 progid)
+{
+  u32 i;
+
+  for (i = 0; i < g_job_count; i++)
+  {
+    if (g_jobs[i].progid == progid)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int registered(u64 progid)
+{
+  int i;
+
+  for (i = 0; i < WARMUP_REGISTERED; i++)
+  {
+    if (g_registered[i].prog_handle != 0 && g_registered[i].progid == progid)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void publish(void)
+{
+  warmup_job *job;
+  u32 i;
+
+  for (i = 0; i < g_job_count; i++)
+  {
+    job = &g_jobs[i];
+    // one pm registered meanwhile keeps its slot free until it is dropped
+    g_handles[job->slot] = job->prog_handle;
+    g_progids[job->slot] = job->ok && !registered(job->progid) ? job->progid : 0;
+  }
+  g_job_count = 0;
+}
+
+// publishes the worker's results if it is done, returns whether it is
+static int warmup_poll(void)
+{
+  if (g_running && worker_done(&g_worker))
+  {
+    worker_join(&g_worker);
+    g_running = 0;
+    publish();
+  }
+  return !g_running;
+}
+
+// a free slot, or the next one round-robin that is not being filled
+static u32 pick_slot(void)
+{
+  int slot;
+
+  slot = find(0);
+  if (slot < 0)
+  {
+    for (slot = g_next; g_progids[slot] == SLOT_PENDING; slot = (slot + 1) % WARMUP_ENTRIES);
+  }
+  g_next = (slot + 1) % WARMUP_ENTRIES;
+  g_progids[slot] = SLOT_PENDING;
+  return slot;
+}
+
+void warmup_start(const exheader_header *exheader)
+{
+  warmup_job *job;
+  u64 progid;
+  u32 i;
+
+  if (!WARMUP_ENABLE || !warmup_poll())
+  {
+    return;
+  }
+  for (i = 0; i < DEPLIST_COUNT && g_job_count < WARMUP_ENTRIES; i++)
+  {
+    progid = exheader->deplist.programid[i];
+    if (progid == 0 || find(progid) >= 0 || queued(progid) || registered(progid))
+    {
+      continue;
+    }
+    job = &g_jobs[g_job_count++];
+    job->progid = progid;
+    job->slot = pick_slot();
+    job->stale_handle = g_handles[job->slot];
+    job->prog_handle = 0;
+    job->ok = 0;
+    g_handles[job->slot] = 0;
+  }
+  if (g_job_count == 0)
+  {
+    return;
+  }
+  if (R_FAILED(worker_start(&g_worker, warmup_main, NULL, g_stack, sizeof(g_stack),
+        worker_current_priority() + 1, -2)))
+  {
+    for (i = 0; i < g_job_count; i++)
+    {
+      g_handles[g_jobs[i].slot] = g_jobs[i].stale_handle;
+      g_progids[g_jobs[i].slot] = 0;
+    }
+    g_job_count = 0;
+    return;
+  }
+  g_running = 1;
+}
+
+u64 warmup_claim(u64 progid, const exheader_header **exheader)
+{
+  u64 prog_handle;
+  int slot;
+
+  *exheader = NULL;
+  if (!WARMUP_ENABLE || progid == 0 || progid == SLOT_PENDING)
+  {
+    return 0;
+  }
+  warmup_poll();
+  slot = find(progid);
+  if (slot < 0)
+  {
+    return 0;
+  }
+  prog_handle = g_handles[slot];
+  g_progids[slot] = 0;
+  g_handles[slot] = 0;
+  *exheader = &g_exheaders[slot];
+  return prog_handle;
+}
+
+void warmup_registered(u64 prog_handle, u64 progid)
+{
+  int slot;
+  int i;
+
+  if (!WARMUP_ENABLE)
+  {
+    return;
+  }
+  for (i = 0; i < WARMUP_REGISTERED && g_registered[i].prog_handle != 0; i++);
+  if (i < WARMUP_REGISTERED)
+  {
+    g_registered[i].prog_handle = prog_handle;
+    g_registered[i].progid = progid;
+  }
+  // registered some other way than through the slot
+  slot = find(progid);
+  if (slot >= 0)
+  {
+    g_progids[slot] = 0;
+  }
+}
+
+void warmup_unregistered(u64 prog_handle)
+{
+  int i;
+
+  if (!WARMUP_ENABLE)
+  {
+    return;
+  }
+  for (i = 0; i < WARMUP_REGISTERED; i++)
+  {
+    if (g_registered[i].prog_handle == prog_handle)
+    {
+      g_registered[i].prog_handle = 0;
+    }
+  }
+}
+
+void warmup_stop(void)
+{
+  int i;
+
+  if (!WARMUP_ENABLE)
+  {
+    return;
+  }
+  if (g_running)
+  {
+    worker_join(&g_worker);
+    g_running = 0;
+    publish();
+  }
+  for (i = 0; i < WARMUP_ENTRIES; i++)
+  {
+    if (g_handles[i] != 0)
+    {
+      FSREG_UnloadProgram(g_handles[i]);
+      g_handles[i] = 0;
+    }
+    g_progids[i] = 0;
+  }
+}
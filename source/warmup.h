@@ -0,0 +1,20 @@
+#pragma once
+
+#include <3ds/types.h>
+#include "exheader.h"
+
+// the programs a title depends on, registered on NAND and their exheaders
+// fetched ahead of their launch
+
+// queues the dependencies of exheader that are not registered and fetches
+// them in the background, unless the last ones are still being fetched
+void warmup_start(const exheader_header *exheader);
+// the registration made here for progid with its exheader, or 0 if it has
+// none ready, never waits; the exheader stays valid until the next
+// warmup_start and the handle is the caller's to unload
+u64 warmup_claim(u64 progid, const exheader_header **exheader);
+// pm registered or unregistered a program
+void warmup_registered(u64 prog_handle, u64 progid);
+void warmup_unregistered(u64 prog_handle);
+// waits for the worker and drops the registrations no one claimed
+void warmup_stop(void);
@@ -0,0 +1,44 @@
+#include <3ds.h>
+#include "worker.h"
+
+static void worker_main(void *arg)
+{
+  worker_t *worker;
+
+  worker = (worker_t *)arg;
+  worker->entry(worker->arg);
+  svcExitThread();
+}
+
+Result worker_start(worker_t *worker, ThreadFunc entry, void *arg, void *stack, u32 stack_size, s32 prio, s32 core)
+{
+  u32 *stack_top;
+
+  worker->entry = entry;
+  worker->arg = arg;
+  stack_top = (u32 *)(((u32)stack + stack_size) & ~7);
+  return svcCreateThread(&worker->thread, worker_main, (u32)worker, stack_top, prio, core);
+}
+
+void worker_join(worker_t *worker)
+{
+  svcWaitSynchronization(worker->thread, U64_MAX);
+  svcCloseHandle(worker->thread);
+  worker->thread = 0;
+}
+
+int worker_done(worker_t *worker)
+{
+  return svcWaitSynchronization(worker->thread, 0) == 0;
+}
+
+s32 worker_current_priority(void)
+{
+  s32 prio;
+
+  if (R_FAILED(svcGetThreadPriority(&prio, CUR_THREAD_HANDLE)))
+  {
+    prio = 0x30;
+  }
+  return prio;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <3ds/types.h>
+
+// a kernel thread running on a caller-provided stack, the loader has no heap
+
+typedef struct
+{
+  Handle thread;
+  ThreadFunc entry;
+  void *arg;
+} worker_t;
+
+Result worker_start(worker_t *worker, ThreadFunc entry, void *arg, void *stack, u32 stack_size, s32 prio, s32 core);
+void worker_join(worker_t *worker);
+// whether the thread has returned, without waiting for it
+int worker_done(worker_t *worker);
+s32 worker_current_priority(void);